@@ -1,10 +1,13 @@
 #include "FanController.h"
 #include "SerialPort.h"
+#include "SampleScheduler.h"
+#include "FaultEvent.h"
 #include "json.hpp"
 #include "dcmi_interface_api.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/file.h>
+#include <signal.h>
 #include <syslog.h>
 #include <iostream>
 #include <fstream>
@@ -13,9 +16,11 @@
 
 using json = nlohmann::json;
 using namespace std;
+using namespace chrono;
 
 GlobalParams            g_params;
 std::shared_mutex       params_mutex;
+volatile sig_atomic_t   g_exitFlag = 0;
 
 const string DEFAULT_JSON = R"(
     {
@@ -55,65 +60,263 @@ bool CreateDefaultFile(string filePath)
     return true;
 }
 
+// 运行统计写入临时文件后 rename，读取方不会看到写了一半的内容
+bool WriteStatsFile(const FanBackend& backend, const CardTelemetryPool& cardPool, const SampleScheduler& scheduler,
+    const vector<const SensorWorker*>& workers, const FaultEventMonitor& faultMonitor)
+{
+    json                    root;
+    const EmergencyStats&   stats = g_fanTable.GetEmergencyStats();
+    string                  tmpPath = string(STATS_FILE_PATH) + ".tmp";
+    FanBackendStats         backendStats;
+
+    backend.GetStats(backendStats);
+    root["backend"]["name"] = backend.Name();
+    root["backend"]["generation"] = backend.Generation();
+    for(auto it = backendStats.begin(); it != backendStats.end(); ++it)
+    {
+        root["backend"][it->first] = it->second;
+    }
+    root["cards"]["poll_ms"] = cardPool.LastPollMs();
+    root["cards"]["list"] = json::array();
+    vector<CardSample> samples = cardPool.Snapshot();
+    for(auto it = samples.begin(); it != samples.end(); ++it)
+    {
+        json card;
+        card["card_id"] = it->cardId;
+        card["temp"] = it->tempRet == 0 ? json(it->temp) : json(nullptr);
+        card["power_w"] = it->powerRet == 0 ? json(it->power / 10.0) : json(nullptr);
+        card["health"] = it->healthRet == 0 ? json(it->health) : json(nullptr);
+        card["cost_ms"] = it->costMs;
+        card["stale"] = it->stale;
+        card["stale_count"] = it->staleCnt;
+        card["overrun_count"] = it->overrunCnt;
+        card["hot_device"] = it->hotDevice;
+        card["devices"] = json::array();
+        for(auto dev = it->devices.begin(); dev != it->devices.end(); ++dev)
+        {
+            json device;
+            device["device_id"] = dev->deviceId;
+            device["temp"] = dev->tempRet == 0 ? json(dev->temp) : json(nullptr);
+            device["hbm_temp"] = dev->hbmRet == 0 ? json(dev->hbmTemp) : json(nullptr);
+            device["cost_ms"] = dev->costMs;
+            card["devices"].push_back(device);
+        }
+        root["cards"]["list"].push_back(card);
+    }
+    vector<SampleTaskStats> taskStats = scheduler.GetStats();
+    for(auto it = taskStats.begin(); it != taskStats.end(); ++it)
+    {
+        json& task = root["sampling"][it->name];
+        task["period_ms"] = it->periodMs;
+        task["deadline_ms"] = it->deadlineMs;
+        task["run_count"] = it->runCnt;
+        task["miss_count"] = it->missCnt;
+        task["defer_count"] = it->deferCnt;
+        task["trigger_count"] = it->triggerCnt;
+        task["overrun_count"] = it->overrunCnt;
+        task["jitter_last_ms"] = it->lastJitterMs;
+        task["jitter_max_ms"] = it->maxJitterMs;
+        task["jitter_avg_ms"] = it->jitterCnt > 0 ? it->totalJitterMs / it->jitterCnt : 0;
+        task["last_cost_ms"] = it->lastCostMs;
+        task["max_cost_ms"] = it->maxCostMs;
+    }
+    root["sampling"]["budget_overrun_count"] = scheduler.BudgetOverrunCount();
+    for(auto it = workers.begin(); it != workers.end(); ++it)
+    {
+        if(*it == NULL)
+        {
+            continue;
+        }
+
+        SensorWorkerStats workerStats = (*it)->GetStats();
+        json& worker = root["sensors"][(*it)->Name()];
+        worker["request_count"] = workerStats.requestCnt;
+        worker["stale_count"] = workerStats.staleCnt;
+        worker["overrun_count"] = workerStats.overrunCnt;
+        worker["last_cost_ms"] = workerStats.lastCostMs;
+        worker["max_cost_ms"] = workerStats.maxCostMs;
+    }
+    root["fault_events"]["event_count"] = faultMonitor.EventCount();
+    root["fault_events"]["match_count"] = faultMonitor.MatchCount();
+    root["emergency"]["count"] = stats.count;
+    root["emergency"]["last_ms"] = stats.lastMs;
+    root["emergency"]["max_ms"] = stats.maxMs;
+    root["emergency"]["avg_ms"] = stats.count > 0 ? stats.totalMs / stats.count : 0;
+
+    ofstream outfile(tmpPath);
+    IF_COND_FAIL(outfile.is_open(), "[ERROR] WriteStatsFile: Fail to create " STATS_FILE_PATH ".tmp", return false);
+
+    outfile << root.dump(4) << endl;
+    outfile.close();
+
+    IF_COND_FAIL(rename(tmpPath.data(), STATS_FILE_PATH) == 0, "[ERROR] WriteStatsFile: Fail to rename " STATS_FILE_PATH, return false);
+    return true;
+}
+
+static bool SameProfile(const PidProfile& a, const PidProfile& b)
+{
+    return a.kp == b.kp && a.ki == b.ki && a.kd == b.kd && a.pwmMin == b.pwmMin && a.pwmMax == b.pwmMax
+        && a.targetTemp == b.targetTemp && a.minTemp == b.minTemp && a.safeTemp == b.safeTemp && a.criticalTemp == b.criticalTemp;
+}
+
+static void ApplyPidProfile(FanController& ctrl, const PidProfile& profile, const string& name)
+{
+    if(SameProfile(ctrl.Profile(), profile))
+    {
+        return;
+    }
+
+    ctrl.SetProfile(profile);
+    syslog(LOG_INFO, "[INFO] %s pid: kp %.2f ki %.2f kd %.2f, pwm %d-%d, target %d, safe %d, critical %d.", name.c_str(), profile.kp,
+        profile.ki, profile.kd, profile.pwmMin, profile.pwmMax, profile.targetTemp, profile.safeTemp, profile.criticalTemp);
+}
+
+// 启动时和配置文件修改后调用，参数在主线程中替换，控制周期内不会读到一半的值
+void ApplyPidProfiles(CPUController& cpuCtrl, SysController& sysCtrl, vector<CardController>& cardCtrlVec)
+{
+    ApplyPidProfile(cpuCtrl, LoadPidProfile(MODE_FILE_PATH, PID_ROLE_CPU, ""), "cpu");
+    ApplyPidProfile(sysCtrl, LoadPidProfile(MODE_FILE_PATH, PID_ROLE_MAINBOARD, ""), "mainboard");
+    for(auto it = cardCtrlVec.begin(); it != cardCtrlVec.end(); ++it)
+    {
+        ApplyPidProfile(*it, LoadPidProfile(MODE_FILE_PATH, PID_ROLE_CARD, it->ProductType()), "card " + to_string(it->CardId()) + " " + it->ProductType());
+    }
+}
+
+static long long ConfigMtime()
+{
+    struct stat buffer;
+
+    return stat(MODE_FILE_PATH, &buffer) == 0 ? buffer.st_mtim.tv_sec * 1000000000LL + buffer.st_mtim.tv_nsec : 0;
+}
+
+// 只补上缺失的 mode / card_fan_bus_id_list，保留文件中的其他节点（serial、pid 等）
+static bool AddMissingParams(const string& filePath)
+{
+    int     ret = -1;
+    int     fd = -1;
+    json    defaults = json::parse(DEFAULT_JSON);
+
+    // 写锁
+    fd = open(filePath.data(), O_WRONLY, S_IRUSR | S_IWUSR);
+    IF_COND_FAIL(fd != -1, (string("[ERROR] AddMissingParams: Failed to get fd")+filePath).data(), return false);
+
+    ret = flock(fd, LOCK_EX);
+    IF_COND_FAIL(ret != -1, "[ERROR] AddMissingParams: Failed to lock file, LOCK_EX", close(fd); return false);
+
+    // 拿到写锁后重新读取，期间可能已被 ManualFanControl 修改
+    ifstream    infile(filePath);
+    json        root = json::parse(infile, nullptr, false);
+    infile.close();
+    if(root.is_discarded() || !root.is_object())
+    {
+        flock(fd, LOCK_UN);
+        close(fd);
+        return false;
+    }
+
+    for(auto it = defaults.begin(); it != defaults.end(); ++it)
+    {
+        if(!root.contains(it.key()))
+        {
+            root[it.key()] = it.value();
+        }
+    }
+
+    ofstream outfile(filePath);
+    IF_COND_FAIL(outfile.is_open(), "[ERROR] AddMissingParams: Fail to open /etc/FanControlParams.json", flock(fd, LOCK_UN); close(fd); return false);
+
+    outfile << root.dump(4) << endl;
+    outfile.close();
+
+    // 解锁
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    return true;
+}
+
+// 解析失败或字段类型错误时保留上一次有效的参数，只在出错原因变化时记录日志
 void* ParamsListen(void* arg)
 {
     int         ret = -1;
     int         fd = -1;
     json        root;
+    string      lastError;
 
     while(true)
     {
+        string  error;
+        bool    missing = false;
+
         // 读锁
         fd = open(MODE_FILE_PATH, O_WRONLY, S_IRUSR | S_IWUSR);
-        IF_COND_FAIL(fd != -1, (string("[ERROR] ParamsListen : Failed to get fd")+MODE_FILE_PATH).data(), continue;);
-        
+        IF_COND_FAIL(fd != -1, (string("[ERROR] ParamsListen : Failed to get fd")+MODE_FILE_PATH).data(), sleep(1); continue;);
+
         ret = flock(fd, LOCK_SH);
-        IF_COND_FAIL(ret != -1, "[ERROR] ParamsListen : Failed to lock file, LOCK_SH", continue;);
+        IF_COND_FAIL(ret != -1, "[ERROR] ParamsListen : Failed to lock file, LOCK_SH", close(fd); sleep(1); continue;);
 
-        // 解析 json
+        // 解析 json，语法错误不抛异常
         ifstream  file(MODE_FILE_PATH);
-        IF_COND_FAIL(file.is_open(), "[ERROR] ParamsListen : Failed to open file", continue;);
+        root = file.is_open() ? json::parse(file, nullptr, false) : json(nullptr);
+        file.close();
+
+        //解锁
+        flock(fd, LOCK_UN);
+        close(fd);
 
-        file >> root;
-        if(root["mode"].is_null() || !root["mode"].is_boolean())
+        if(root.is_discarded() || !root.is_object())
         {
-            syslog(LOG_INFO, "[ERROR] ParamsListen : Failed to parse json file, mode is null or not bool type. Create default json file.");
-            // cout << "[ERROR] ParamsListen : Failed to parse json file, mode is null or not bool type. Create default json file." << endl;
-            CreateDefaultFile(MODE_FILE_PATH);
-            continue;
+            error = "invalid json, keep last params";
         }
-        else if(root["card_fan_bus_id_list"].is_null() || !root["card_fan_bus_id_list"].is_array())
+        else if(!root.contains("mode") || !root.contains("card_fan_bus_id_list"))
         {
-            syslog(LOG_INFO, "[ERROR] ParamsListen : Failed to parse json file, card_fan_bus_id_list is null or not array type. Create default json file.");
-            // cout << "[ERROR] ParamsListen : Failed to parse json file, card_fan_bus_id_list is null or not array type. Create default json file." << endl;
-            CreateDefaultFile(MODE_FILE_PATH);
-            continue;
+            missing = true;
+            error = "mode or card_fan_bus_id_list is missing, add default value";
+        }
+        else if(!root["mode"].is_boolean())
+        {
+            error = "mode is not bool type, keep last params";
+        }
+        else if(!root["card_fan_bus_id_list"].is_array()
+            || !all_of(root["card_fan_bus_id_list"].begin(), root["card_fan_bus_id_list"].end(), [](const json& id) { return id.is_number_integer(); }))
+        {
+            error = "card_fan_bus_id_list is not integer array type, keep last params";
         }
 
-        g_params.update(root["mode"], root["card_fan_bus_id_list"].get<vector<int>>());
-
-        //解锁
-        flock(fd, LOCK_UN);
-        close(fd);
+        if(error.empty())
+        {
+            g_params.update(root["mode"], root["card_fan_bus_id_list"].get<vector<int>>());
+        }
+        else if(error != lastError)
+        {
+            syslog(LOG_INFO, "[ERROR] ParamsListen : Failed to parse json file, %s.", error.c_str());
+        }
+        lastError = error;
 
-        //重置变量，间隔1s
+        // 缺少字段时补写后立即重新读取，其余情况间隔1s
         root.clear();
         ret = fd = -1;
+        if(missing && AddMissingParams(MODE_FILE_PATH))
+        {
+            continue;
+        }
         sleep(1);
     }
 
     return NULL;
 }
 
+// systemd 停止服务时退出主循环，让后端析构时交还风扇控制权
+static void OnExitSignal(int sig)
+{
+    g_exitFlag = 1;
+}
+
 int main()
 {
-    int                     fd = 0;
     int                     ret = -1;
     pthread_t               paramsTid;
-
-    // 打开串口
-    ret = SerialOpen(&fd);
-    IF_COND_FAIL(ret == 0, "[ERROR] Fail to open serial port /dev/fanctrl, process exit", return -1);
+    unique_ptr<FanBackend>  pBackend;
 
     // 检查配置文件是否存在，不存在就创建默认的
     // if(!filesystem::exists(MODE_FILE_PATH))
@@ -122,20 +325,44 @@ int main()
         IF_COND_FAIL(CreateDefaultFile(MODE_FILE_PATH), "CreateDefaultFile fail, process exit", return -1);
     }
 
+    // 链路参数非法时沿用缺省值
+    SerialLoadConfig(MODE_FILE_PATH);
+
+    // 按配置或探测选择风扇后端，之后长期持有，出错时由后端自行重连
+    pBackend = CreateFanBackend(MODE_FILE_PATH);
+    IF_COND_FAIL(pBackend != nullptr, "[ERROR] No fan backend available (serial/ioctl/hwmon), process exit", return -1);
+    signal(SIGTERM, OnExitSignal);
+    signal(SIGINT, OnExitSignal);
+
     // 创建线程，不断更新 g_params
     pthread_create(&paramsTid, NULL, ParamsListen, NULL);
     pthread_detach(paramsTid);
 
-    CPUController           cpuCtrl(fd);
-    SysController           sysCtrl(fd);
+    CPUController           cpuCtrl(pBackend.get());
+    SysController           sysCtrl(pBackend.get());
     bool                    resetFlag = false;
     int                     cardNum = 0;
     int                     cardList[8] = {0};
     vector<CardController>  cardCtrlVec;
+    CardTelemetryPool       cardPool;
+    SampleScheduler         scheduler;
+    FaultEventMonitor       faultMonitor;
+    int                     cpuTaskId = -1;
+    int                     sysTaskId = -1;
+    int                     cardTaskId = -1;
+    SampleConfig            sampleConfig = LoadSampleConfig(MODE_FILE_PATH);
+    auto                    statsDue = steady_clock::now();
+    long long               pidMtime = 0;
+
+    // 启动时发现一次 thermal zone 和 hwmon 传感器，按名字而不是编号选择
+    vector<SensorInfo>      sensors = DiscoverTempSensors();
+    cpuCtrl.LoadSensors(sensors, MODE_FILE_PATH);
+    sysCtrl.LoadSensors(sensors, MODE_FILE_PATH);
 
     // 先开cpu和sys的风扇
     cpuCtrl.SetPwm();
     sysCtrl.SetPwm();
+    g_fanTable.Flush(*pBackend);
 
     ret = dcmi_init();
     IF_COND_FAIL(ret == 0 || ret == -8005, ("[ERROR] dcmi_init fail, ret is" + to_string(ret) + ", process exit").data(), return -1;);
@@ -148,49 +375,125 @@ int main()
     for(int i = 0; i < cardNum; ++i)
     {
         // cout << "[INFO] card_list[" << i << "] is " << cardList[i] << endl;
-        CardController item(fd, cardList[i]);
+        CardController item(pBackend.get(), cardList[i], &cardPool);
         cardCtrlVec.push_back(item);
     }
 
-    while(true)
+    // 各卡的 dcmi 查询并行执行，周期耗时取决于最慢的一张卡
+    cardPool.Start(cardList, cardNum);
+
+    // 各传感器按自己的周期采样并立即参与计算，便宜的 cpu 温度可以比 dcmi、串口查询快得多
+    // 每次采样最多等自己的截止时间和本轮剩余预算中较小的一个，读取卡死时沿用上一次的结果
+    auto waitMs = [&scheduler](int deadlineMs) { return max(0, min(deadlineMs, scheduler.RemainingBudgetMs())); };
+    scheduler.SetBudget(sampleConfig.budgetMs);
+    // 温度变化快时缩短周期，平稳时逐步拉长，减少空闲时的唤醒和串口、dcmi 查询
+    cpuTaskId = scheduler.Add("cpu", sampleConfig.cpuMs, 0, [&] {
+        cpuCtrl.SetDeadline(waitMs(sampleConfig.cpuDeadlineMs));
+        cpuCtrl.SetPwm();
+        scheduler.SetPeriod(cpuTaskId, cpuCtrl.NextPeriodMs(sampleConfig.cpuAdaptive));
+    });
+    sysTaskId = scheduler.Add("mainboard", sampleConfig.sysMs, 0, [&] {
+        sysCtrl.SetDeadline(waitMs(sampleConfig.sysDeadlineMs));
+        sysCtrl.SetPwm();
+        scheduler.SetPeriod(sysTaskId, sysCtrl.NextPeriodMs(sampleConfig.sysAdaptive));
+    });
+    cardTaskId = scheduler.Add("cards", sampleConfig.cardMs, 0, [&] {
+        // 故障事件对应的卡先按超温处理，紧急命令在查询之前发出
+        vector<FaultNotice> notices = faultMonitor.Take();
+        vector<bool>        faultFlags(cardCtrlVec.size(), false);
+        for(auto notice = notices.begin(); notice != notices.end(); ++notice)
+        {
+            for(size_t i = 0; i < cardCtrlVec.size(); ++i)
+            {
+                if(notice->cardId < 0 || notice->cardId == cardCtrlVec[i].CardId())
+                {
+                    cardCtrlVec[i].ForceCritical(notice->time);
+                    faultFlags[i] = true;
+                }
+            }
+        }
+        for(size_t i = 0; i < cardCtrlVec.size(); ++i)
+        {
+            if(faultFlags[i])
+            {
+                cardCtrlVec[i].SetPwm();
+            }
+        }
+
+        cardPool.Poll(waitMs(sampleConfig.cardDeadlineMs));
+        for(size_t i = 0; i < cardCtrlVec.size(); ++i)
+        {
+            if(!faultFlags[i])
+            {
+                cardCtrlVec[i].SetPwm();
+            }
+        }
+
+        // 所有卡共用一次并行查询，周期取变化最快的卡
+        int periodMs = sampleConfig.cardAdaptive.maxMs;
+        for(auto it = cardCtrlVec.begin(); it != cardCtrlVec.end(); ++it)
+        {
+            periodMs = min(periodMs, it->NextPeriodMs(sampleConfig.cardAdaptive));
+        }
+        scheduler.SetPeriod(cardTaskId, periodMs);
+    });
+
+    // 卡上报温度类故障时立即唤醒主循环执行一次 cards 任务，不等 dcmi 轮询周期
+    faultMonitor.Start(cardList, cardNum, LoadFaultEventConfig(MODE_FILE_PATH), [&scheduler, cardTaskId] { scheduler.Trigger(cardTaskId); });
+
+    // PID 参数和限值可在运行中修改配置文件调整，不需要重新编译部署
+    ApplyPidProfiles(cpuCtrl, sysCtrl, cardCtrlVec);
+    pidMtime = ConfigMtime();
+
+    while(!g_exitFlag)
     {
         if(g_params.getMode())
         {
             if(resetFlag)
             {
-                // 打开串口
-                ret = SerialOpen(&fd);
-                IF_COND_FAIL(ret == 0, "[ERROR] Fail to open serial port /dev/fanctrl, process exit", return -1);
-
-                cpuCtrl.Restart(fd);
-                sysCtrl.Restart(fd);
+                cpuCtrl.Restart();
+                sysCtrl.Restart();
                 for(auto it = cardCtrlVec.begin(); it != cardCtrlVec.end(); ++it)
                 {
-                    it->Restart(fd);
+                    it->Restart();
                 }
 
+                // 手动模式期间风扇可能被 ManFanCtrl 改过
+                g_fanTable.Invalidate();
+                scheduler.Restart();
+
                 resetFlag = false;
             }
 
-            cpuCtrl.SetPwm();
-            sysCtrl.SetPwm();
-            for(auto it = cardCtrlVec.begin(); it != cardCtrlVec.end(); ++it)
-            {
-                it->SetPwm();
-            }
+            // 睡到最早到期的采样任务，本轮产生的风扇命令一次发出
+            scheduler.RunOnce();
+            g_fanTable.Flush(*pBackend);
         }
         else
         {
+            // 后端保持打开，手动模式下不收发
+            if(!resetFlag)
+            {
+                syslog(LOG_INFO, "[INFO] Mode is Manual, auto control paused.");
+            }
+
             resetFlag = true;
+            sleep(STATS_PERIOD_S);
+        }
 
-            // 关闭串口
-            SerialClose(&fd);
-            syslog(LOG_INFO, "[INFO] Serial port close, mode is Manual.");
-            // cout << "[INFO] Serial port close, mode is Manual." << endl;
+        if(ConfigMtime() != pidMtime)
+        {
+            pidMtime = ConfigMtime();
+            ApplyPidProfiles(cpuCtrl, sysCtrl, cardCtrlVec);
         }
 
-        sleep(5);
+        if(steady_clock::now() >= statsDue)
+        {
+            WriteStatsFile(*pBackend, cardPool, scheduler, {cpuCtrl.Worker(), sysCtrl.Worker()}, faultMonitor);
+            statsDue = steady_clock::now() + seconds(STATS_PERIOD_S);
+        }
     }
 
+    syslog(LOG_INFO, "[INFO] Exit on signal, release fan backend %s.", pBackend->Name());
     return 0;
 }
\ No newline at end of file
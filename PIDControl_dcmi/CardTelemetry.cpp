@@ -0,0 +1,313 @@
+#include "CardTelemetry.h"
+#include "dcmi_interface_api.h"
+#include <syslog.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+using namespace chrono;
+
+CardTelemetryPool::CardTelemetryPool()
+    : m_pShared(make_shared<Shared>()), m_lastPollMs(0)
+{
+
+}
+
+CardTelemetryPool::~CardTelemetryPool()
+{
+    Stop();
+}
+
+int CardTelemetryPool::Start(const int* cardList, int cardNum, int workerNum)
+{
+    Stop();
+
+    // 上一次 Start 分离的线程可能仍持有旧状态，重新分配一份
+    shared_ptr<Shared> pShared = make_shared<Shared>();
+    pShared->cards.assign(cardList, cardList + cardNum);
+    m_snapshot.assign(cardNum, CardSample());
+    for(int i = 0; i < cardNum; ++i)
+    {
+        int deviceNum = 0;
+        int ret = dcmi_get_device_num_in_card(cardList[i], &deviceNum);
+        if(ret != 0 || deviceNum <= 0)
+        {
+            syslog(LOG_INFO, "[ERROR] CardTelemetryPool: card %d dcmi_get_device_num_in_card fail, ret %d, use device 0 only.", cardList[i], ret);
+            deviceNum = 1;
+        }
+        deviceNum = min(deviceNum, CARD_MAX_DEVICE_NUM);
+
+        m_snapshot[i].cardId = cardList[i];
+        m_snapshot[i].devices.assign(deviceNum, DeviceSample());
+        for(int device = 0; device < deviceNum; ++device)
+        {
+            m_snapshot[i].devices[device].deviceId = device;
+            pShared->jobs.push_back({(size_t)i, device});
+        }
+    }
+
+    pShared->results.assign(pShared->jobs.size(), DeviceSample());
+    pShared->inFlight.assign(pShared->jobs.size(), false);
+    pShared->resultNew.assign(pShared->jobs.size(), false);
+
+    workerNum = min(workerNum, min((int)pShared->jobs.size(), CARD_POOL_MAX_WORKERS));
+    pShared->running = workerNum;
+    m_pShared = pShared;
+    for(int i = 0; i < workerNum; ++i)
+    {
+        m_workers.emplace_back(&CardTelemetryPool::WorkerLoop, pShared);
+    }
+
+    syslog(LOG_INFO, "[INFO] CardTelemetryPool: %d cards, %d devices, %d workers.", cardNum, (int)pShared->jobs.size(), workerNum);
+    return 0;
+}
+
+void CardTelemetryPool::Stop()
+{
+    shared_ptr<Shared>  pShared = m_pShared;
+    bool                exited = false;
+
+    {
+        unique_lock<mutex> lock(pShared->mutex);
+        pShared->stop = true;
+        pShared->taskCv.notify_all();
+        exited = pShared->exitCv.wait_for(lock, milliseconds(CARD_POOL_STOP_WAIT_MS), [&pShared] { return pShared->running == 0; });
+    }
+
+    // 超时仍卡在 dcmi 调用里的线程只能分离，返回后只访问自己持有的共享状态
+    if(!exited)
+    {
+        syslog(LOG_INFO, "[ERROR] CardTelemetryPool: workers still in dcmi after %d ms, detach them.", CARD_POOL_STOP_WAIT_MS);
+    }
+
+    for(auto it = m_workers.begin(); it != m_workers.end(); ++it)
+    {
+        if(exited)
+        {
+            it->join();
+        }
+        else
+        {
+            it->detach();
+        }
+    }
+    m_workers.clear();
+}
+
+void CardTelemetryPool::Query(int cardId, DeviceSample& sample)
+{
+    union dcmi_sensor_info  hbmInfo;
+    auto                    start = steady_clock::now();
+
+    sample.tempRet = dcmi_get_device_temperature(cardId, sample.deviceId, &sample.temp);
+    memset(&hbmInfo, 0, sizeof(hbmInfo));
+    sample.hbmRet = dcmi_get_device_sensor_info(cardId, sample.deviceId, DCMI_HBM_TEMP_ID, &hbmInfo);
+    sample.hbmTemp = hbmInfo.iint;
+    sample.powerRet = dcmi_get_device_power_info(cardId, sample.deviceId, &sample.power);
+    sample.healthRet = dcmi_get_device_health(cardId, sample.deviceId, &sample.health);
+
+    sample.time = steady_clock::now();
+    sample.costMs = duration<double, milli>(sample.time - start).count();
+}
+
+void CardTelemetryPool::Summarize(CardSample& card)
+{
+    bool tempFound = false;
+
+    card.temp = 0;
+    card.hotDevice = 0;
+    card.power = 0;
+    card.health = 0;
+    card.tempRet = 0;
+    card.powerRet = 0;
+    card.healthRet = 0;
+    card.costMs = 0;
+    for(auto it = card.devices.begin(); it != card.devices.end(); ++it)
+    {
+        int hotTemp = it->temp;
+        if(it->hbmRet == 0)
+        {
+            hotTemp = max(hotTemp, it->hbmTemp);
+        }
+
+        if(it->tempRet != 0)
+        {
+            card.tempRet = card.tempRet != 0 ? card.tempRet : it->tempRet;
+        }
+        else if(!tempFound || hotTemp > card.temp)
+        {
+            tempFound = true;
+            card.temp = hotTemp;
+            card.hotDevice = it->deviceId;
+        }
+
+        card.powerRet = card.powerRet != 0 ? card.powerRet : it->powerRet;
+        card.power += it->powerRet == 0 ? it->power : 0;
+        card.healthRet = card.healthRet != 0 ? card.healthRet : it->healthRet;
+        card.health = max(card.health, it->healthRet == 0 ? it->health : 0);
+        card.time = it == card.devices.begin() ? it->time : min(card.time, it->time);
+        card.costMs = max(card.costMs, it->costMs);
+    }
+}
+
+void CardTelemetryPool::WorkerLoop(shared_ptr<Shared> pShared)
+{
+    Shared&             shared = *pShared;
+    unique_lock<mutex>  lock(shared.mutex);
+
+    while(true)
+    {
+        shared.taskCv.wait(lock, [&shared] { return shared.stop || !shared.queue.empty(); });
+        if(shared.stop)
+        {
+            --shared.running;
+            shared.exitCv.notify_all();
+            return;
+        }
+
+        size_t          index = shared.queue.back();
+        unsigned        round = shared.round;
+        int             cardId = shared.cards[shared.jobs[index].cardIndex];
+        DeviceSample    sample;
+        shared.queue.pop_back();
+        sample.deviceId = shared.jobs[index].deviceId;
+
+        // dcmi 调用耗时几十毫秒，锁外执行
+        lock.unlock();
+        Query(cardId, sample);
+        lock.lock();
+
+        // 超时后才返回的结果同样保留，下一轮进入快照
+        shared.results[index] = sample;
+        shared.inFlight[index] = false;
+        shared.resultNew[index] = true;
+        if(round == shared.round && --shared.pending == 0)
+        {
+            shared.doneCv.notify_one();
+        }
+    }
+}
+
+int CardTelemetryPool::Poll(int deadlineMs)
+{
+    int     failNum = 0;
+    auto    start = steady_clock::now();
+
+    Shared&             shared = *m_pShared;
+    unique_lock<mutex>  lock(shared.mutex);
+    if(m_workers.empty())
+    {
+        return 0;
+    }
+
+    ++shared.round;
+    shared.pending = 0;
+    shared.queue.clear();
+    vector<bool> overrun(shared.cards.size(), false);
+    for(size_t i = 0; i < shared.jobs.size(); ++i)
+    {
+        // 上一轮的查询还没返回，本轮不再下发
+        if(shared.inFlight[i])
+        {
+            overrun[shared.jobs[i].cardIndex] = true;
+            continue;
+        }
+
+        shared.inFlight[i] = true;
+        shared.queue.push_back(i);
+        ++shared.pending;
+    }
+    shared.taskCv.notify_all();
+
+    auto done = [&shared] { return shared.pending == 0; };
+    if(deadlineMs < 0)
+    {
+        shared.doneCv.wait(lock, done);
+    }
+    else
+    {
+        shared.doneCv.wait_for(lock, milliseconds(deadlineMs), done);
+    }
+
+    // 没有按时返回的芯片保留上一次的数据和采样时刻，整张卡标记为 stale
+    vector<bool> missed(shared.cards.size(), false);
+    for(size_t i = 0; i < shared.jobs.size(); ++i)
+    {
+        CardSample& snap = m_snapshot[shared.jobs[i].cardIndex];
+
+        if(shared.resultNew[i])
+        {
+            shared.resultNew[i] = false;
+            snap.devices[shared.jobs[i].deviceId] = shared.results[i];
+        }
+        else
+        {
+            missed[shared.jobs[i].cardIndex] = true;
+        }
+    }
+
+    for(size_t i = 0; i < shared.cards.size(); ++i)
+    {
+        CardSample& snap = m_snapshot[i];
+
+        Summarize(snap);
+        snap.overrunCnt += overrun[i] ? 1 : 0;
+        if(missed[i])
+        {
+            snap.stale = true;
+            ++snap.staleRounds;
+            ++snap.staleCnt;
+            syslog(LOG_INFO, "[ERROR] CardTelemetryPool: card %d missed deadline %d ms, stale %d rounds.", snap.cardId, deadlineMs, snap.staleRounds);
+        }
+        else
+        {
+            snap.stale = false;
+            snap.staleRounds = 0;
+        }
+
+        if(snap.tempRet != 0 || snap.stale)
+        {
+            ++failNum;
+        }
+    }
+
+    // 未下发的任务不再执行，避免超时后堆积
+    for(auto it = shared.queue.begin(); it != shared.queue.end(); ++it)
+    {
+        shared.inFlight[*it] = false;
+    }
+    shared.queue.clear();
+
+    m_lastPollMs = duration<double, milli>(steady_clock::now() - start).count();
+    return failNum;
+}
+
+bool CardTelemetryPool::GetSample(int cardId, CardSample& sample) const
+{
+    lock_guard<mutex> lock(m_pShared->mutex);
+
+    for(auto it = m_snapshot.begin(); it != m_snapshot.end(); ++it)
+    {
+        if(it->cardId == cardId)
+        {
+            sample = *it;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+vector<CardSample> CardTelemetryPool::Snapshot() const
+{
+    lock_guard<mutex> lock(m_pShared->mutex);
+
+    return m_snapshot;
+}
+
+double CardTelemetryPool::LastPollMs() const
+{
+    lock_guard<mutex> lock(m_pShared->mutex);
+
+    return m_lastPollMs;
+}
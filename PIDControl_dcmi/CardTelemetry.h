@@ -0,0 +1,111 @@
+#ifndef __CARD_TELEMETRY_H__
+#define __CARD_TELEMETRY_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 三个 dcmi 版本目录各自打包发布，PIDControl_dcmi、PIDControl_ioctl_dcmi、PIDControl_ioctl_dcmi_no_sysfan 中的
+// CardTelemetry.h/.cpp 是同一份文件，修改时三处一起更新
+#define CARD_POOL_MAX_WORKERS   16      //8 张卡、每卡最多 2 个芯片，芯片再多也不超过该线程数
+#define CARD_MAX_DEVICE_NUM     4
+#define CARD_POOL_STOP_WAIT_MS  500     //Stop 等待工作线程从 dcmi 调用返回的最长时间
+
+// 卡上一个芯片一次查询的结果，ret 为对应 dcmi 接口的返回值
+struct DeviceSample
+{
+    int                                     deviceId = 0;
+    int                                     temp = 0;       //SoC 温度
+    int                                     hbmTemp = 0;
+    int                                     power = 0;      //单位 0.1W
+    unsigned int                            health = 0;     //0 正常，1 一般告警，2 重要告警，3 紧急告警
+    int                                     tempRet = -1;
+    int                                     hbmRet = -1;    //没有 HBM 的芯片返回失败，不影响控制
+    int                                     powerRet = -1;
+    int                                     healthRet = -1;
+    std::chrono::steady_clock::time_point   time;
+    double                                  costMs = 0;
+};
+
+// 一张卡所有芯片的汇总：温度取 SoC、HBM 中最热的一个，功耗求和，健康状态取最差
+// 任一芯片的 SoC 温度读取失败时 tempRet 非 0；time 取最旧的芯片采样时刻
+struct CardSample
+{
+    int                                     cardId = -1;
+    int                                     temp = 0;
+    int                                     hotDevice = 0;
+    int                                     power = 0;      //单位 0.1W
+    unsigned int                            health = 0;
+    int                                     tempRet = -1;
+    int                                     powerRet = -1;
+    int                                     healthRet = -1;
+    std::chrono::steady_clock::time_point   time;
+    double                                  costMs = 0;     //最慢的芯片
+    std::vector<DeviceSample>               devices;
+    bool                                    stale = false;      //本轮没有在截止时间内返回，保留上一轮的数据
+    int                                     staleRounds = 0;
+    long long                               staleCnt = 0;
+    long long                               overrunCnt = 0;     //上一轮的查询还没返回，本轮没有下发
+};
+
+// 固定数量的工作线程并行查询各卡每个芯片的温度、功耗、健康状态，Atlas 300I Duo 等多芯片卡的每个芯片都是一个任务
+// Poll 最多等到截止时间后整体替换快照，控制器读到的是同一轮的数据
+// 某个芯片的 dcmi 调用卡死时只占住一个线程，所在的卡标记为 stale，其他卡照常更新
+class CardTelemetryPool
+{
+public:
+    CardTelemetryPool();
+    ~CardTelemetryPool();
+
+    int Start(const int* cardList, int cardNum, int workerNum = CARD_POOL_MAX_WORKERS);
+    void Stop();
+
+    // 启动时用 dcmi_get_device_num_in_card 确定每张卡的芯片数
+    // deadlineMs 小于 0 时等待全部返回；返回本轮失败或超时的卡数
+    int Poll(int deadlineMs = -1);
+    bool GetSample(int cardId, CardSample& sample) const;
+    std::vector<CardSample> Snapshot() const;
+    double LastPollMs() const;
+
+private:
+    // 一个查询任务：cards 中的下标和芯片编号
+    struct Job
+    {
+        size_t  cardIndex;
+        int     deviceId;
+    };
+
+    // 工作线程与线程池共享的状态，每个线程持有一份引用
+    // Stop 超时后分离的线程仍卡在 dcmi 调用里，返回时访问的是这份状态而不是已析构的线程池
+    struct Shared
+    {
+        std::mutex                  mutex;
+        std::condition_variable     taskCv;
+        std::condition_variable     doneCv;
+        std::condition_variable     exitCv;
+        std::vector<int>            cards;
+        std::vector<Job>            jobs;
+        std::vector<DeviceSample>   results;            //与 jobs 一一对应
+        std::vector<size_t>         queue;
+        std::vector<bool>           inFlight;
+        std::vector<bool>           resultNew;          //有返回但还没进入快照的结果
+        unsigned                    round = 0;
+        int                         pending = 0;
+        int                         running = 0;        //还没有退出的工作线程数
+        bool                        stop = false;
+    };
+
+    static void WorkerLoop(std::shared_ptr<Shared> pShared);
+    static void Query(int cardId, DeviceSample& sample);
+    static void Summarize(CardSample& card);
+
+    std::shared_ptr<Shared>     m_pShared;          //m_snapshot、m_lastPollMs 同样由 m_pShared->mutex 保护
+    std::vector<std::thread>    m_workers;
+    std::vector<CardSample>     m_snapshot;
+    double                      m_lastPollMs;
+};
+
+#endif // __CARD_TELEMETRY_H__
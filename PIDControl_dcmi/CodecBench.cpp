@@ -0,0 +1,85 @@
+#include "FanProtocol.h"
+#include <chrono>
+#include <string>
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+
+using namespace std;
+using namespace chrono;
+
+#define BENCH_LOOPS 5000000
+
+// 统计堆分配次数
+static long long s_allocCnt = 0;
+
+void* operator new(size_t size)
+{
+    ++s_allocCnt;
+    void* p = malloc(size);
+    if(p == NULL)
+    {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// 旧的命令拼接方式
+string Int2StrPadZero(int value, int length)
+{
+    string result = to_string(value);
+    if (result.length() < length)
+    {
+        result = string(length - result.length(), '0').append(result);
+    }
+
+    return result;
+}
+
+template<typename Func>
+void RunBench(const char* name, Func func)
+{
+    volatile int    sink = 0;
+    long long       allocStart = s_allocCnt;
+    auto            start = steady_clock::now();
+
+    for(int i = 0; i < BENCH_LOOPS; ++i)
+    {
+        sink += func(i % (FAN_CHANNEL_MAX + 1), i % (FAN_PWM_MAX + 1));
+    }
+
+    double ns = duration<double, nano>(steady_clock::now() - start).count() / BENCH_LOOPS;
+    double allocs = (double)(s_allocCnt - allocStart) / BENCH_LOOPS;
+    cout << name << ": " << ns << " ns/cmd, " << allocs << " allocs/cmd" << endl;
+}
+
+int main()
+{
+    RunBench("string  $FxSyyy", [](int channel, int pwm) {
+        string cmd = "$F" + to_string(channel) + "S" + Int2StrPadZero(pwm, 3);
+        return (int)cmd[6];
+    });
+
+    RunBench("codec   $FxSyyy", [](int channel, int pwm) {
+        char cmd[FAN_CMD_BUF_SIZE];
+        EncodeSetPwm(cmd, FAN_CMD_BUF_SIZE, channel, pwm);
+        return (int)cmd[6];
+    });
+
+    RunBench("codec   !GTP", [](int channel, int pwm) {
+        char cmd[FAN_CMD_BUF_SIZE];
+        return EncodeQuery(cmd, FAN_CMD_BUF_SIZE, FAN_QUERY_TEMP) + cmd[0];
+    });
+
+    return 0;
+}
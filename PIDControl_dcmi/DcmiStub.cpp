@@ -0,0 +1,526 @@
+// dcmi 桩库：在没有 Atlas 卡的机器上代替 libdcmi.so，卡的数据来自场景文件
+// 场景文件路径取环境变量 DCMI_STUB_SCENARIO，缺省为当前目录的 DcmiScenario.json，格式见该文件
+// 用法：make stub && make LDFLAGS=-Ldcmistub all，然后以 LD_LIBRARY_PATH=dcmistub 运行 AutoFanCtrl / ManFanCtrl
+#include "dcmi_interface_api.h"
+#include "json.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace chrono;
+using json = nlohmann::json;
+
+#define STUB_SCENARIO_FILE      "DcmiScenario.json"
+#define STUB_MAX_DEVICE_NUM     4       //phy id = 卡序号 * STUB_MAX_DEVICE_NUM + 芯片号
+
+// 单个接口的注入：每次调用先延迟 latency_ms ± jitter_ms，再按 error_rate 返回 error_code
+struct CallSpec
+{
+    int     latencyMs = 0;
+    int     jitterMs = 0;
+    double  errorRate = 0;
+    int     errorCode = DCMI_ERR_CODE_INNER_ERR;
+};
+
+// 按场景时间（秒）线性插值的曲线，最后一个点之后保持不变
+typedef vector<pair<double, double>> Curve;
+
+struct StubCard
+{
+    int                     cardId = 0;
+    string                  product = "Atlas 300I Pro";
+    int                     busId = 0;
+    int                     deviceNum = 1;
+    Curve                   temp = {{0, 45}};
+    double                  deviceStep = 0;     //n 号芯片比 0 号高 n * device_step
+    double                  hbmOffset = 0;
+    bool                    hbm = false;        //没有配置 hbm_offset 时 HBM 传感器读取失败
+    Curve                   power = {{0, 70}};  //单位 W
+    Curve                   utilization = {{0, 0}};
+    unsigned int            health = 0;
+    map<string, CallSpec>   calls;
+};
+
+struct StubEvent
+{
+    double          atS = 0;
+    int             cardIndex = 0;
+    int             deviceId = 0;
+    unsigned int    eventId = 0;
+    string          name;
+    int             severity = 2;
+    int             assertion = 1;
+};
+
+struct StubScenario
+{
+    vector<StubCard>        cards;
+    map<string, CallSpec>   calls;
+    vector<StubEvent>       events;
+    bool                    subscribe = true;   //false 时订阅失败，调用方只能用 dcmi_get_fault_event
+    double                  loopS = 0;          //大于 0 时场景时间按该周期循环
+};
+
+static once_flag                            s_loadOnce;
+static StubScenario                         s_scenario;
+static steady_clock::time_point             s_start;
+static mutex                                s_mutex;
+static condition_variable                   s_eventCv;
+static mt19937                              s_rng(12345);
+static vector<dcmi_fault_event_callback>    s_handlers;
+static map<int, deque<struct dcmi_event>>   s_eventQueue;   //按芯片物理 id 排队，供 dcmi_get_fault_event 取
+static thread                               s_eventThread;
+
+static Curve LoadCurve(const json& node, const Curve& def)
+{
+    Curve curve;
+
+    if(node.is_number())
+    {
+        return Curve{{0, node.get<double>()}};
+    }
+
+    if(!node.is_array())
+    {
+        return def;
+    }
+
+    for(auto it = node.begin(); it != node.end(); ++it)
+    {
+        if(it->is_array() && it->size() == 2 && (*it)[0].is_number() && (*it)[1].is_number())
+        {
+            curve.push_back({(*it)[0].get<double>(), (*it)[1].get<double>()});
+        }
+    }
+    sort(curve.begin(), curve.end());
+
+    return curve.empty() ? def : curve;
+}
+
+static double CurveAt(const Curve& curve, double t)
+{
+    if(t <= curve.front().first)
+    {
+        return curve.front().second;
+    }
+
+    for(size_t i = 1; i < curve.size(); ++i)
+    {
+        if(t < curve[i].first)
+        {
+            double ratio = (t - curve[i - 1].first) / (curve[i].first - curve[i - 1].first);
+            return curve[i - 1].second + ratio * (curve[i].second - curve[i - 1].second);
+        }
+    }
+
+    return curve.back().second;
+}
+
+static void LoadCalls(const json& node, map<string, CallSpec>& calls)
+{
+    if(!node.is_object())
+    {
+        return;
+    }
+
+    for(auto it = node.begin(); it != node.end(); ++it)
+    {
+        CallSpec spec;
+        spec.latencyMs = it->value("latency_ms", 0);
+        spec.jitterMs = it->value("jitter_ms", 0);
+        spec.errorRate = it->value("error_rate", 0.0);
+        spec.errorCode = it->value("error_code", DCMI_ERR_CODE_INNER_ERR);
+        calls[it.key()] = spec;
+    }
+}
+
+static double ScenarioTime()
+{
+    double t = duration<double>(steady_clock::now() - s_start).count();
+
+    return s_scenario.loopS > 0 ? fmod(t, s_scenario.loopS) : t;
+}
+
+static void FireEvent(const StubEvent& stubEvent)
+{
+    struct dcmi_event event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = DCMI_DMS_FAULT_EVENT;
+    struct dcmi_dms_fault_event& dms = event.event_t.dms_event;
+    dms.event_id = stubEvent.eventId;
+    dms.deviceid = stubEvent.cardIndex * STUB_MAX_DEVICE_NUM + stubEvent.deviceId;
+    dms.severity = stubEvent.severity;
+    dms.assertion = stubEvent.assertion;
+    snprintf(dms.event_name, sizeof(dms.event_name), "%s", stubEvent.name.c_str());
+
+    fprintf(stderr, "[dcmi stub] %.3f s: card %d event 0x%x %s\n", ScenarioTime(), s_scenario.cards[stubEvent.cardIndex].cardId,
+        stubEvent.eventId, stubEvent.name.c_str());
+
+    vector<dcmi_fault_event_callback> handlers;
+    {
+        lock_guard<mutex> lock(s_mutex);
+        handlers = s_handlers;
+        s_eventQueue[dms.deviceid].push_back(event);
+    }
+    s_eventCv.notify_all();
+
+    for(auto it = handlers.begin(); it != handlers.end(); ++it)
+    {
+        (*it)(&event);
+    }
+}
+
+// 按场景时间依次产生故障事件，循环场景只产生第一轮
+static void EventLoop()
+{
+    for(auto it = s_scenario.events.begin(); it != s_scenario.events.end(); ++it)
+    {
+        this_thread::sleep_until(s_start + duration_cast<steady_clock::duration>(duration<double>(it->atS)));
+        FireEvent(*it);
+    }
+}
+
+static void LoadScenario()
+{
+    const char* path = getenv("DCMI_STUB_SCENARIO");
+
+    s_start = steady_clock::now();
+    path = path != NULL ? path : STUB_SCENARIO_FILE;
+
+    ifstream file(path);
+    json root = json::parse(file, nullptr, false);
+    if(root.is_discarded() || !root.is_object())
+    {
+        fprintf(stderr, "[dcmi stub] fail to load scenario %s, use one default card.\n", path);
+        s_scenario.cards.push_back(StubCard());
+        return;
+    }
+
+    if(root.contains("cards") && root["cards"].is_array())
+    {
+        for(auto it = root["cards"].begin(); it != root["cards"].end(); ++it)
+        {
+            StubCard card;
+            card.cardId = it->value("card_id", (int)s_scenario.cards.size());
+            card.product = it->value("product", card.product);
+            card.busId = it->value("bus_id", card.cardId + 1);
+            card.deviceNum = max(1, min(it->value("devices", 1), STUB_MAX_DEVICE_NUM));
+            card.temp = LoadCurve(it->value("temp", json()), card.temp);
+            card.deviceStep = it->value("device_step", 0.0);
+            card.hbm = it->contains("hbm_offset");
+            card.hbmOffset = it->value("hbm_offset", 0.0);
+            card.power = LoadCurve(it->value("power", json()), card.power);
+            card.utilization = LoadCurve(it->value("utilization", json()), card.utilization);
+            card.health = it->value("health", 0u);
+            LoadCalls(it->value("calls", json()), card.calls);
+            s_scenario.cards.push_back(card);
+        }
+    }
+
+    LoadCalls(root.value("calls", json()), s_scenario.calls);
+    s_scenario.subscribe = root.value("subscribe", true);
+    s_scenario.loopS = root.value("loop_s", 0.0);
+
+    if(root.contains("events") && root["events"].is_array())
+    {
+        for(auto it = root["events"].begin(); it != root["events"].end(); ++it)
+        {
+            StubEvent event;
+            int cardId = it->value("card_id", 0);
+            for(size_t i = 0; i < s_scenario.cards.size(); ++i)
+            {
+                if(s_scenario.cards[i].cardId == cardId)
+                {
+                    event.cardIndex = i;
+                }
+            }
+            event.atS = it->value("at_s", 0.0);
+            event.deviceId = it->value("device_id", 0);
+            event.eventId = it->value("event_id", 0u);
+            event.name = it->value("name", string("Temperature Over Threshold"));
+            event.severity = it->value("severity", 2);
+            event.assertion = it->value("assertion", 1);
+            s_scenario.events.push_back(event);
+        }
+        sort(s_scenario.events.begin(), s_scenario.events.end(), [](const StubEvent& a, const StubEvent& b) { return a.atS < b.atS; });
+    }
+
+    if(s_scenario.cards.empty())
+    {
+        s_scenario.cards.push_back(StubCard());
+    }
+
+    if(!s_scenario.events.empty())
+    {
+        s_eventThread = thread(EventLoop);
+        s_eventThread.detach();
+    }
+
+    fprintf(stderr, "[dcmi stub] scenario %s: %d cards, %d events.\n", path, (int)s_scenario.cards.size(), (int)s_scenario.events.size());
+}
+
+static StubCard* FindCard(int cardId, int deviceId)
+{
+    call_once(s_loadOnce, LoadScenario);
+
+    for(auto it = s_scenario.cards.begin(); it != s_scenario.cards.end(); ++it)
+    {
+        if(it->cardId == cardId)
+        {
+            return deviceId >= 0 && deviceId < it->deviceNum ? &*it : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+// 卡上的配置优先，其次是全局配置；同一层中具体接口名优先于 "*"
+// 返回 0 表示继续返回模拟数据
+static int Inject(const char* call, const StubCard* card)
+{
+    const CallSpec*                 spec = NULL;
+    const map<string, CallSpec>*    levels[2] = {card != NULL ? &card->calls : NULL, &s_scenario.calls};
+
+    for(int i = 0; i < 2 && spec == NULL; ++i)
+    {
+        if(levels[i] == NULL)
+        {
+            continue;
+        }
+
+        auto it = levels[i]->find(call);
+        if(it == levels[i]->end())
+        {
+            it = levels[i]->find("*");
+        }
+        spec = it != levels[i]->end() ? &it->second : NULL;
+    }
+
+    if(spec == NULL)
+    {
+        return 0;
+    }
+
+    int     delayMs = spec->latencyMs;
+    bool    fail = false;
+    {
+        lock_guard<mutex> lock(s_mutex);
+        if(spec->jitterMs > 0)
+        {
+            delayMs += uniform_int_distribution<int>(-spec->jitterMs, spec->jitterMs)(s_rng);
+        }
+        fail = uniform_real_distribution<double>(0, 1)(s_rng) < spec->errorRate;
+    }
+
+    if(delayMs > 0)
+    {
+        this_thread::sleep_for(milliseconds(delayMs));
+    }
+
+    return fail ? spec->errorCode : 0;
+}
+
+#define STUB_ENTER(card, deviceId)                                          \
+    StubCard* pCard = FindCard(card, deviceId);                             \
+    if(pCard == NULL)                                                       \
+    {                                                                       \
+        return DCMI_ERR_CODE_DEVICE_NOT_EXIST;                              \
+    }                                                                       \
+    int injectRet = Inject(__func__, pCard);                                \
+    if(injectRet != 0)                                                      \
+    {                                                                       \
+        return injectRet;                                                   \
+    }
+
+
+// 导出的 dcmi 接口
+int dcmi_init(void)
+{
+    call_once(s_loadOnce, LoadScenario);
+
+    return Inject(__func__, NULL);
+}
+
+int dcmi_get_card_list(int* card_num, int* card_list, int list_len)
+{
+    call_once(s_loadOnce, LoadScenario);
+    int ret = Inject(__func__, NULL);
+    if(ret != 0)
+    {
+        return ret;
+    }
+
+    if(card_num == NULL || card_list == NULL)
+    {
+        return DCMI_ERR_CODE_INVALID_PARAMETER;
+    }
+
+    *card_num = min((int)s_scenario.cards.size(), list_len);
+    for(int i = 0; i < *card_num; ++i)
+    {
+        card_list[i] = s_scenario.cards[i].cardId;
+    }
+
+    return 0;
+}
+
+int dcmi_get_card_num_list(int* card_num, int* card_list, int list_len)
+{
+    return dcmi_get_card_list(card_num, card_list, list_len);
+}
+
+int dcmi_get_device_num_in_card(int card_id, int* device_num)
+{
+    STUB_ENTER(card_id, 0);
+
+    *device_num = pCard->deviceNum;
+    return 0;
+}
+
+int dcmi_get_pcie_info(int card_id, int device_id, struct dcmi_tag_pcie_idinfo* pcie_idinfo)
+{
+    STUB_ENTER(card_id, device_id);
+
+    memset(pcie_idinfo, 0, sizeof(*pcie_idinfo));
+    pcie_idinfo->venderid = 0x19e5;
+    pcie_idinfo->deviceid = 0xd500;
+    pcie_idinfo->bdf_busid = pCard->busId;
+    pcie_idinfo->bdf_deviceid = device_id;
+    return 0;
+}
+
+int dcmi_get_product_type(int card_id, int device_id, char* product_type_str, int buf_size)
+{
+    STUB_ENTER(card_id, device_id);
+
+    snprintf(product_type_str, buf_size, "%s", pCard->product.c_str());
+    return 0;
+}
+
+int dcmi_get_device_temperature(int card_id, int device_id, int* temperature)
+{
+    STUB_ENTER(card_id, device_id);
+
+    *temperature = (int)lround(CurveAt(pCard->temp, ScenarioTime()) + device_id * pCard->deviceStep);
+    return 0;
+}
+
+int dcmi_get_device_sensor_info(int card_id, int device_id, enum dcmi_manager_sensor_id sensor_id, union dcmi_sensor_info* sensor_info)
+{
+    STUB_ENTER(card_id, device_id);
+
+    double socTemp = CurveAt(pCard->temp, ScenarioTime()) + device_id * pCard->deviceStep;
+    memset(sensor_info, 0, sizeof(*sensor_info));
+    switch(sensor_id)
+    {
+    case DCMI_SOC_TEMP_ID:
+        sensor_info->iint = (int)lround(socTemp);
+        return 0;
+    case DCMI_HBM_TEMP_ID:
+        if(!pCard->hbm)
+        {
+            return DCMI_ERR_CODE_NOT_SUPPORT;
+        }
+        sensor_info->iint = (int)lround(socTemp + pCard->hbmOffset);
+        return 0;
+    default:
+        return DCMI_ERR_CODE_NOT_SUPPORT;
+    }
+}
+
+int dcmi_get_device_power_info(int card_id, int device_id, int* power)
+{
+    STUB_ENTER(card_id, device_id);
+
+    // 单位 0.1W，卡功耗平均分到各芯片
+    *power = (int)lround(CurveAt(pCard->power, ScenarioTime()) * 10 / pCard->deviceNum);
+    return 0;
+}
+
+int dcmi_mcu_get_power_info(int card_id, int* power)
+{
+    STUB_ENTER(card_id, 0);
+
+    *power = (int)lround(CurveAt(pCard->power, ScenarioTime()) * 10);
+    return 0;
+}
+
+int dcmi_get_device_utilization_rate(int card_id, int device_id, int input_type, unsigned int* utilization_rate)
+{
+    STUB_ENTER(card_id, device_id);
+
+    *utilization_rate = (unsigned int)lround(CurveAt(pCard->utilization, ScenarioTime()));
+    return 0;
+}
+
+int dcmi_get_device_health(int card_id, int device_id, unsigned int* health)
+{
+    STUB_ENTER(card_id, device_id);
+
+    *health = pCard->health;
+    return 0;
+}
+
+int dcmi_subscribe_fault_event(int card_id, int device_id, struct dcmi_event_filter filter, dcmi_fault_event_callback handler)
+{
+    STUB_ENTER(card_id, device_id);
+
+    if(!s_scenario.subscribe)
+    {
+        return DCMI_ERR_CODE_NOT_SUPPORT;
+    }
+
+    // 同一个回调订阅多张卡时只调用一次，与真实驱动按进程回调一致
+    lock_guard<mutex> lock(s_mutex);
+    if(find(s_handlers.begin(), s_handlers.end(), handler) == s_handlers.end())
+    {
+        s_handlers.push_back(handler);
+    }
+    return 0;
+}
+
+int dcmi_get_fault_event(int card_id, int device_id, int timeout, struct dcmi_event_filter filter, struct dcmi_event* event)
+{
+    STUB_ENTER(card_id, device_id);
+
+    int cardIndex = pCard - &s_scenario.cards[0];
+    unique_lock<mutex> lock(s_mutex);
+    deque<struct dcmi_event>& queue = s_eventQueue[cardIndex * STUB_MAX_DEVICE_NUM + device_id];
+    if(!s_eventCv.wait_for(lock, milliseconds(max(timeout, 0)), [&queue] { return !queue.empty(); }))
+    {
+        return DCMI_ERR_CODE_TIME_OUT;
+    }
+
+    *event = queue.front();
+    queue.pop_front();
+    return 0;
+}
+
+int dcmi_get_card_id_device_id_from_phyid(int* card_id, int* device_id, unsigned int device_phy_id)
+{
+    call_once(s_loadOnce, LoadScenario);
+
+    unsigned int cardIndex = device_phy_id / STUB_MAX_DEVICE_NUM;
+    if(cardIndex >= s_scenario.cards.size() || (int)(device_phy_id % STUB_MAX_DEVICE_NUM) >= s_scenario.cards[cardIndex].deviceNum)
+    {
+        return DCMI_ERR_CODE_INVALID_DEVICE_ID;
+    }
+
+    *card_id = s_scenario.cards[cardIndex].cardId;
+    *device_id = device_phy_id % STUB_MAX_DEVICE_NUM;
+    return 0;
+}
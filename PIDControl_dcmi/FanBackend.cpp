@@ -0,0 +1,626 @@
+#include "FanBackend.h"
+#include "SerialPort.h"
+#include "FanProtocol.h"
+#include "json.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <syslog.h>
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+
+#define CMD_REPLY_TIMEOUT_MS 200    //单条命令等待应答的截止时间
+#define CMD_BATCH_STEP_MS 20        //批量发送时每多一条命令增加的等待时间
+#define SYS_TEMP_RETRY 2
+
+using namespace std;
+using json = nlohmann::json;
+
+// SerialBackend 成员函数
+int SerialBackend::Probe()
+{
+    int temp = 0;
+
+    if(m_session.Open() != 0)
+    {
+        return FAN_PROBE_FAIL;
+    }
+
+    return ReadSysTemp(&temp) == 0 ? FAN_PROBE_VERIFIED : FAN_PROBE_OPENED;
+}
+
+int SerialBackend::WritePwm(FanPwmOp* ops, int opNum)
+{
+    int             ret = -1;
+    int             acked = 0;
+    char            cmdList[FAN_BACKEND_CHANNEL_NUM][FAN_CMD_BUF_SIZE];
+    struct iovec    iov[FAN_BACKEND_CHANNEL_NUM];
+
+    opNum = min(opNum, FAN_BACKEND_CHANNEL_NUM);
+    for(int i = 0; i < opNum; ++i)
+    {
+        iov[i].iov_base = cmdList[i];
+        iov[i].iov_len = EncodeSetPwm(cmdList[i], FAN_CMD_BUF_SIZE, ops[i].channel, ops[i].pwm);
+    }
+
+    int fd = m_session.Fd();
+    if(fd == 0)
+    {
+        syslog(LOG_INFO, "[ERROR] Serial port %s is not open.", SerialDevPath());
+        return 0;
+    }
+
+    ret = SerialWriteV(fd, iov, opNum);
+    m_session.Report(ret);
+    if(ret != 0)
+    {
+        syslog(LOG_INFO, "[ERROR] SerialBackend: Failed to write the command batch.");
+        return 0;
+    }
+
+    ret = SerialReadFrames(fd, m_recvBuf, sizeof(m_recvBuf), opNum, CMD_REPLY_TIMEOUT_MS + opNum * CMD_BATCH_STEP_MS);
+
+    // 固件的设置应答格式没有文档约定，缺省与原先一样写入成功即视为生效，只读走应答；
+    // 没有应答不算链路超时，只有读出错才交给会话重连
+    if(!SerialGetConfig().ackEcho)
+    {
+        if((unsigned int)ret == SERIAL_READ_ERROR)
+        {
+            m_session.Report(ret);
+        }
+
+        for(int i = 0; i < opNum; ++i)
+        {
+            ops[i].acked = true;
+        }
+        return opNum;
+    }
+
+    m_session.Report(ret);
+
+    // 按回显的通道和占空比对应到命令，丢失或迟到的应答不会把后面的确认错位到别的通道
+    // 最后一段没有 '\n' 的数据也作为一帧解析，不要求板子用换行分帧
+    char* frame = m_recvBuf;
+    char* bufEnd = m_recvBuf + (ret > 0 ? ret : 0);
+    while(frame < bufEnd && acked < opNum)
+    {
+        // SerialReadFrames 保证缓冲区以 '\0' 结尾，bufEnd 可以直接当作最后一帧的帧尾
+        char* end = (char*)memchr(frame, '\n', bufEnd - frame);
+        if(end == NULL)
+        {
+            end = bufEnd;
+        }
+
+        FanSetPwmReply reply;
+        int            match = -1;
+        if(ParseSetPwmReply(frame, end - frame, &reply) == FAN_REPLY_OK)
+        {
+            for(int k = 0; k < opNum && match < 0; ++k)
+            {
+                if(!ops[k].acked && ops[k].channel == reply.channel && ops[k].pwm == reply.pwm)
+                {
+                    match = k;
+                }
+            }
+        }
+
+        if(match >= 0)
+        {
+            ops[match].acked = true;
+            ++acked;
+        }
+        else
+        {
+            *end = '\0';
+            syslog(LOG_INFO, "[ERROR] SerialBackend: Unmatched reply %s, status %s.", frame, FanReplyStatusStr(reply.status));
+        }
+        frame = end + 1;
+    }
+
+    for(int i = 0; i < opNum; ++i)
+    {
+        if(!ops[i].acked)
+        {
+            syslog(LOG_INFO, "[ERROR] SerialBackend: No valid reply for cmd %s.", cmdList[i]);
+        }
+    }
+
+    return acked;
+}
+
+int SerialBackend::ReadSysTemp(int* pTemp)
+{
+    int             ret = -1;
+    char            cmd[FAN_CMD_BUF_SIZE] = {0};
+    FanTempReply    reply;
+
+    EncodeQuery(cmd, FAN_CMD_BUF_SIZE, FAN_QUERY_TEMP);
+
+    // 应答不完整或错乱时重发
+    for(int i = 0; i <= SYS_TEMP_RETRY; ++i)
+    {
+        int fd = m_session.Fd();
+        if(fd == 0)
+        {
+            syslog(LOG_INFO, "[ERROR] Serial port %s is not open.", SerialDevPath());
+            return -1;
+        }
+
+        ret = SerialWrite(fd, cmd, strlen(cmd));
+        if(ret == 0)
+        {
+            ret = SerialReadFrame(fd, m_recvBuf, sizeof(m_recvBuf), CMD_REPLY_TIMEOUT_MS);
+        }
+        m_session.Report(ret);
+        if(ret < 0)
+        {
+            syslog(LOG_INFO, "[ERROR] SerialBackend: Fail to read sys temp, ret 0x%x", (unsigned int)ret);
+            continue;
+        }
+
+        if(ParseTempReply(m_recvBuf, ret, &reply) == FAN_REPLY_OK)
+        {
+            *pTemp = reply.temp;
+            return 0;
+        }
+
+        syslog(LOG_INFO, "[ERROR] Fail to parse mainboard temperatrue, reply is %s: %s", FanReplyStatusStr(reply.status), m_recvBuf);
+    }
+
+    return -1;
+}
+
+void SerialBackend::GetStats(FanBackendStats& stats) const
+{
+    stats.push_back(make_pair("baud", (long long)m_session.LinkBaud()));
+    stats.push_back(make_pair("reconnect_count", (long long)m_session.ReconnectCount()));
+    stats.push_back(make_pair("reconnect_ms", m_session.ReconnectMs()));
+}
+
+
+// IoctlBackend 成员函数
+IoctlBackend::IoctlBackend(const vector<int>& channelMap, const char* configPath)
+    : m_channelMap(channelMap), m_sysTemp(SYS_TEMP_FILE_PATH), m_reopenSeen(0)
+{
+    m_dev.LoadVerifyConfig(configPath);
+    fill(m_fanAck, m_fanAck + SIO_FAN_MAX, -1);
+    fill(m_fanPwm, m_fanPwm + SIO_FAN_MAX, -1);
+    fill(m_demand, m_demand + FAN_BACKEND_CHANNEL_NUM, -1);
+    fill(m_stale, m_stale + FAN_BACKEND_CHANNEL_NUM, false);
+}
+
+int IoctlBackend::Probe()
+{
+    if(m_dev.Open() != 0)
+    {
+        return FAN_PROBE_FAIL;
+    }
+
+    // 读一次已映射风扇的转速，确认驱动可用
+    for(size_t i = 0; i < m_channelMap.size(); ++i)
+    {
+        if(m_channelMap[i] < 0)
+        {
+            continue;
+        }
+
+        int index = m_dev.QueueRpm(m_channelMap[i]);
+        m_dev.Submit();
+        return m_dev.Result(index) == 0 ? FAN_PROBE_VERIFIED : FAN_PROBE_OPENED;
+    }
+
+    return FAN_PROBE_OPENED;
+}
+
+int IoctlBackend::FanDemand(int fanNum) const
+{
+    int pwm = -1;
+
+    for(int i = 0; i < FAN_BACKEND_CHANNEL_NUM && i < (int)m_channelMap.size(); ++i)
+    {
+        if(m_channelMap[i] == fanNum)
+        {
+            pwm = max(pwm, m_demand[i]);
+        }
+    }
+
+    return pwm;
+}
+
+int IoctlBackend::WritePwm(FanPwmOp* ops, int opNum)
+{
+    int     acked = 0;
+    int     fanWrite[SIO_FAN_MAX];
+    char    name[SIO_NAME_LEN] = {0};
+
+    // 设备重开后风扇状态不可信，调用方会全部重发，这里不能再按旧值跳过
+    if(m_dev.ReopenCount() != m_reopenSeen)
+    {
+        m_reopenSeen = m_dev.ReopenCount();
+        fill(m_fanPwm, m_fanPwm + SIO_FAN_MAX, -1);
+    }
+
+    opNum = min(opNum, FAN_BACKEND_CHANNEL_NUM);
+    for(int i = 0; i < opNum; ++i)
+    {
+        ops[i].acked = false;
+
+        // 不由本后端控制的通道不下发，也不算确认
+        if(!Controls(ops[i].channel))
+        {
+            syslog(LOG_INFO, "[ERROR] IoctlBackend: Channel %d is not mapped to any fan.", ops[i].channel);
+            continue;
+        }
+        m_demand[ops[i].channel] = ops[i].pwm;
+    }
+
+    // 每个涉及的风扇只下发一次；确认地址由本对象持有，SioDevice 在之后的 Submit 中仍可能写入
+    fill(fanWrite, fanWrite + SIO_FAN_MAX, -1);
+    for(int i = 0; i < opNum; ++i)
+    {
+        if(Controls(ops[i].channel))
+        {
+            int fanNum = m_channelMap[ops[i].channel];
+            fanWrite[fanNum] = FanDemand(fanNum);
+        }
+    }
+
+    for(int fanNum = 0; fanNum < SIO_FAN_MAX; ++fanNum)
+    {
+        m_fanAck[fanNum] = -1;
+        if(fanWrite[fanNum] >= 0 && fanWrite[fanNum] != m_fanPwm[fanNum])
+        {
+            snprintf(name, sizeof(name), "fan%d", fanNum);
+            m_dev.QueueWrite(fanNum, fanWrite[fanNum], &m_fanAck[fanNum], name);
+        }
+    }
+
+    m_dev.Submit();
+
+    for(int fanNum = 0; fanNum < SIO_FAN_MAX; ++fanNum)
+    {
+        if(fanWrite[fanNum] >= 0 && fanWrite[fanNum] != m_fanPwm[fanNum])
+        {
+            m_fanPwm[fanNum] = m_fanAck[fanNum] == fanWrite[fanNum] ? fanWrite[fanNum] : -1;
+            continue;
+        }
+
+        // 本批没有设置的风扇被抽查发现不一致，映射到它的通道都要重发
+        if(m_fanAck[fanNum] == 0 && m_fanPwm[fanNum] >= 0)
+        {
+            syslog(LOG_INFO, "[ERROR] IoctlBackend: fan%d audit mismatch, resend pwm %d.", fanNum, m_fanPwm[fanNum]);
+            m_fanPwm[fanNum] = -1;
+            for(int i = 0; i < FAN_BACKEND_CHANNEL_NUM && i < (int)m_channelMap.size(); ++i)
+            {
+                m_stale[i] = m_stale[i] || m_channelMap[i] == fanNum;
+            }
+        }
+    }
+
+    // 共用风扇的通道，风扇已运行在不低于自身需求的值时视为完成
+    for(int i = 0; i < opNum; ++i)
+    {
+        if(Controls(ops[i].channel))
+        {
+            int fanNum = m_channelMap[ops[i].channel];
+            ops[i].acked = m_fanPwm[fanNum] >= 0 && m_fanPwm[fanNum] == fanWrite[fanNum];
+            acked += ops[i].acked ? 1 : 0;
+        }
+    }
+
+    return acked;
+}
+
+bool IoctlBackend::Controls(int channel) const
+{
+    return channel >= 0 && channel < FAN_BACKEND_CHANNEL_NUM && channel < (int)m_channelMap.size()
+        && m_channelMap[channel] >= 0 && m_channelMap[channel] < SIO_FAN_MAX;
+}
+
+int IoctlBackend::TakeStaleChannels(int* channels, int maxNum)
+{
+    int num = 0;
+
+    for(int i = 0; i < FAN_BACKEND_CHANNEL_NUM && num < maxNum; ++i)
+    {
+        if(m_stale[i])
+        {
+            m_stale[i] = false;
+            channels[num++] = i;
+        }
+    }
+
+    return num;
+}
+
+int IoctlBackend::ReadSysTemp(int* pTemp)
+{
+    long long value = 0;
+
+    if(m_sysTemp.Read(&value) != 0)
+    {
+        return -1;
+    }
+
+    *pTemp = value / 1000;
+    return 0;
+}
+
+
+// HwmonBackend 成员函数
+HwmonBackend::HwmonBackend(const string& chipName, const vector<int>& channelMap)
+    : m_chipName(chipName), m_channelMap(channelMap), m_sysTemp(SYS_TEMP_FILE_PATH), m_writeErrCnt(0)
+{
+    for(int i = 0; i < FAN_BACKEND_CHANNEL_NUM; ++i)
+    {
+        m_pwmFd[i] = -1;
+    }
+}
+
+HwmonBackend::~HwmonBackend()
+{
+    for(int i = 0; i < FAN_BACKEND_CHANNEL_NUM; ++i)
+    {
+        if(m_pwmFd[i] >= 0)
+        {
+            close(m_pwmFd[i]);
+        }
+
+        // 交还芯片原来的控制模式
+        if(!m_enableOrig[i].empty())
+        {
+            string enablePath = m_chipPath + "/pwm" + to_string(m_channelMap[i]) + "_enable";
+            int enableFd = open(enablePath.c_str(), O_WRONLY | O_CLOEXEC);
+            if(enableFd < 0 || write(enableFd, m_enableOrig[i].c_str(), m_enableOrig[i].size()) != (ssize_t)m_enableOrig[i].size())
+            {
+                syslog(LOG_INFO, "[ERROR] HwmonBackend: Fail to restore %s to %s.", enablePath.c_str(), m_enableOrig[i].c_str());
+            }
+            if(enableFd >= 0)
+            {
+                close(enableFd);
+            }
+        }
+    }
+}
+
+int HwmonBackend::Probe()
+{
+    // 主板上的第一个 pwm 芯片通常不接加速卡风扇，不猜测
+    if(m_chipName.empty() || m_channelMap.empty())
+    {
+        syslog(LOG_INFO, "[ERROR] HwmonBackend: backend.hwmon_chip and backend.channel_map must be configured.");
+        return FAN_PROBE_FAIL;
+    }
+
+    DIR* dir = opendir(HWMON_ROOT_PATH);
+    if(dir == NULL)
+    {
+        return FAN_PROBE_FAIL;
+    }
+
+    // 找名字匹配的带可写 pwm1 的芯片
+    struct dirent* entry = NULL;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(strncmp(entry->d_name, "hwmon", 5) != 0)
+        {
+            continue;
+        }
+
+        string path = string(HWMON_ROOT_PATH) + "/" + entry->d_name;
+        string name;
+        ifstream nameFile(path + "/name");
+        getline(nameFile, name);
+
+        if(name != m_chipName || access((path + "/pwm1").c_str(), W_OK) != 0)
+        {
+            continue;
+        }
+
+        m_chipPath = path;
+        m_chipName = name;
+        m_chipTemp.SetPath(path + "/temp1_input");
+        break;
+    }
+    closedir(dir);
+
+    if(m_chipPath.empty())
+    {
+        return FAN_PROBE_FAIL;
+    }
+
+    int openCnt = 0;
+    for(int i = 0; i < FAN_BACKEND_CHANNEL_NUM && i < (int)m_channelMap.size(); ++i)
+    {
+        if(m_channelMap[i] <= 0)
+        {
+            continue;
+        }
+
+        string pwmPath = m_chipPath + "/pwm" + to_string(m_channelMap[i]);
+        m_pwmFd[i] = open(pwmPath.c_str(), O_WRONLY | O_CLOEXEC);
+        if(m_pwmFd[i] < 0)
+        {
+            syslog(LOG_INFO, "[INFO] HwmonBackend: %s not available, channel %d not controlled.", pwmPath.c_str(), i);
+            continue;
+        }
+
+        // 切到手动模式，否则写入的 pwm 会被芯片自动控制覆盖；记下原值，退出时恢复
+        string orig;
+        ifstream enableFile(pwmPath + "_enable");
+        getline(enableFile, orig);
+        int enableFd = open((pwmPath + "_enable").c_str(), O_WRONLY | O_CLOEXEC);
+        if(enableFd >= 0)
+        {
+            if(write(enableFd, "1", 1) != 1)
+            {
+                syslog(LOG_INFO, "[ERROR] HwmonBackend: Fail to set %s_enable to manual.", pwmPath.c_str());
+            }
+            else if(!orig.empty() && orig != "1")
+            {
+                m_enableOrig[i] = orig;
+            }
+            close(enableFd);
+        }
+        ++openCnt;
+    }
+
+    syslog(LOG_INFO, "[INFO] HwmonBackend: Use %s (%s), %d pwm channels.", m_chipPath.c_str(), m_chipName.c_str(), openCnt);
+    return openCnt > 0 ? FAN_PROBE_VERIFIED : FAN_PROBE_FAIL;
+}
+
+int HwmonBackend::WritePwm(FanPwmOp* ops, int opNum)
+{
+    int     acked = 0;
+    char    buf[8] = {0};
+
+    for(int i = 0; i < opNum; ++i)
+    {
+        int channel = ops[i].channel;
+        if(!Controls(channel))
+        {
+            ops[i].acked = false;
+            syslog(LOG_INFO, "[ERROR] HwmonBackend: Channel %d has no pwm file.", channel);
+            continue;
+        }
+
+        int len = snprintf(buf, sizeof(buf), "%d", ops[i].pwm * 255 / 100);
+        ops[i].acked = pwrite(m_pwmFd[channel], buf, len, 0) == len;
+        if(!ops[i].acked)
+        {
+            ++m_writeErrCnt;
+            syslog(LOG_INFO, "[ERROR] HwmonBackend: Fail to write pwm%d, errno %d.", m_channelMap[channel], errno);
+            continue;
+        }
+        ++acked;
+    }
+
+    return acked;
+}
+
+bool HwmonBackend::Controls(int channel) const
+{
+    return channel >= 0 && channel < FAN_BACKEND_CHANNEL_NUM && m_pwmFd[channel] >= 0;
+}
+
+int HwmonBackend::ReadSysTemp(int* pTemp)
+{
+    long long value = 0;
+
+    // 优先使用本芯片的温度，没有时与 ioctl 版本一样读 hwmon0
+    if(m_chipTemp.Read(&value) != 0 && m_sysTemp.Read(&value) != 0)
+    {
+        return -1;
+    }
+
+    *pTemp = value / 1000;
+    return 0;
+}
+
+void HwmonBackend::GetStats(FanBackendStats& stats) const
+{
+    stats.push_back(make_pair("write_error_count", m_writeErrCnt));
+    stats.push_back(make_pair("temp_error_count", (long long)(m_chipTemp.ErrorCount() + m_sysTemp.ErrorCount())));
+}
+
+
+// 后端选择
+static unique_ptr<FanBackend> MakeBackend(const string& type, const string& hwmonChip, const vector<int>& ioctlMap,
+    const vector<int>& hwmonMap, const char* configPath)
+{
+    if(type == "serial")
+    {
+        return unique_ptr<FanBackend>(new SerialBackend());
+    }
+    else if(type == "ioctl")
+    {
+        return unique_ptr<FanBackend>(new IoctlBackend(ioctlMap, configPath));
+    }
+    else if(type == "hwmon")
+    {
+        return unique_ptr<FanBackend>(new HwmonBackend(hwmonChip, hwmonMap));
+    }
+
+    return nullptr;
+}
+
+unique_ptr<FanBackend> CreateFanBackend(const char* configPath)
+{
+    string                  type = "auto";
+    string                  hwmonChip;
+    // 与 PIDControl_ioctl_dcmi 的接线一致：主板风扇为 fan_num 2，所有加速卡共用 fan_num 3，cpu 风扇由 BIOS 控制
+    vector<int>             ioctlMap = {-1, 2, 3, 3, 3, 3, 3, 3, 3, 3};
+    vector<int>             hwmonMap;
+    // hwmon 芯片上的 pwm 一般是主板风扇，只有显式配置 type 为 hwmon 时才使用
+    vector<string>          order = {"ioctl", "serial"};
+    unique_ptr<FanBackend>  fallback;
+
+    ifstream file(configPath);
+    json root = json::parse(file, nullptr, false);
+    if(!root.is_discarded() && root.is_object() && root.contains("backend") && root["backend"].is_object())
+    {
+        const json& node = root["backend"];
+        if(node.contains("type") && node["type"].is_string())            type = node["type"];
+        if(node.contains("hwmon_chip") && node["hwmon_chip"].is_string()) hwmonChip = node["hwmon_chip"];
+        if(node.contains("channel_map") && node["channel_map"].is_array())
+        {
+            ioctlMap = hwmonMap = node["channel_map"].get<vector<int>>();
+        }
+    }
+
+    if(type != "auto")
+    {
+        order = {type};
+    }
+    else
+    {
+        // 上次探测成功的后端优先
+        string cached;
+        ifstream cacheFile(FAN_BACKEND_CACHE_PATH);
+        getline(cacheFile, cached);
+        auto it = find(order.begin(), order.end(), cached);
+        if(it != order.end())
+        {
+            rotate(order.begin(), it, it + 1);
+        }
+    }
+
+    for(auto it = order.begin(); it != order.end(); ++it)
+    {
+        unique_ptr<FanBackend> pBackend = MakeBackend(*it, hwmonChip, ioctlMap, hwmonMap, configPath);
+        if(pBackend == nullptr)
+        {
+            syslog(LOG_INFO, "[ERROR] CreateFanBackend: Unknown backend type %s.", it->c_str());
+            continue;
+        }
+
+        int ret = pBackend->Probe();
+        syslog(LOG_INFO, "[INFO] CreateFanBackend: Probe %s backend, result %d.", pBackend->Name(), ret);
+        if(ret == FAN_PROBE_VERIFIED)
+        {
+            // 只缓存自动探测中完成读写验证的后端
+            if(type == "auto")
+            {
+                ofstream cacheFile(FAN_BACKEND_CACHE_PATH);
+                cacheFile << pBackend->Name() << endl;
+            }
+            return pBackend;
+        }
+
+        if(ret == FAN_PROBE_OPENED && fallback == nullptr)
+        {
+            fallback = move(pBackend);
+        }
+    }
+
+    // 能打开但没有应答的设备也比没有强，后续由重连逻辑恢复
+    if(fallback != nullptr)
+    {
+        syslog(LOG_INFO, "[ERROR] CreateFanBackend: No backend verified, use %s.", fallback->Name());
+    }
+
+    return fallback;
+}
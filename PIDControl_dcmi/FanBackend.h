@@ -0,0 +1,127 @@
+#ifndef __FAN_BACKEND_H__
+#define __FAN_BACKEND_H__
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "SerialSession.h"
+#include "SioDevice.h"
+#include "SysfsReader.h"
+
+#define FAN_BACKEND_CACHE_PATH  "/run/FanControlBackend"        //上次探测成功的后端，重启时优先尝试
+#define SYS_TEMP_FILE_PATH      "/sys/class/hwmon/hwmon0/temp1_input"
+#define FAN_BACKEND_CHANNEL_NUM 10                              //与 MAX_FAN_CHANNEL_NUM 一致：cpu、主板、各加速卡
+
+// 探测结果
+#define FAN_PROBE_FAIL          -1      //设备不存在或打不开
+#define FAN_PROBE_OPENED        0       //设备可以打开，但没有通过读写验证
+#define FAN_PROBE_VERIFIED      1       //设备可以打开，且完成了一次读写
+
+// 一条风扇设置，后端按顺序执行，成功的置 acked
+struct FanPwmOp
+{
+    int     channel;
+    int     pwm;
+    bool    acked;
+};
+
+typedef std::vector<std::pair<std::string, long long>> FanBackendStats;
+
+// 风扇执行器/传感器后端：串口风扇板、aaeon_sio ioctl、hwmon pwmN
+// 逻辑通道统一为 0 cpu、1 主板、2 起为 card_fan_bus_id_list 中的各加速卡
+class FanBackend
+{
+public:
+    virtual ~FanBackend() {}
+
+    virtual const char* Name() const = 0;
+    virtual int Probe() = 0;
+    // 一批设置尽量一次提交，返回成功的条数
+    virtual int WritePwm(FanPwmOp* ops, int opNum) = 0;
+    // 主板温度，单位 ℃，失败返回非 0
+    virtual int ReadSysTemp(int* pTemp) = 0;
+    // 逻辑通道是否有对应的风扇，不受控的通道不会交给 WritePwm
+    virtual bool Controls(int channel) const { return channel >= 0 && channel < FAN_BACKEND_CHANNEL_NUM; }
+    // 取走之前确认过、但后来发现风扇实际值不符的通道（如 ioctl 抽查回读不一致），调用方需要重新下发
+    virtual int TakeStaleChannels(int* channels, int maxNum) { return 0; }
+    // 后端重连或重开后加一，风扇状态不再可信
+    virtual int Generation() const { return 0; }
+    virtual void GetStats(FanBackendStats& stats) const {}
+};
+
+// 串口风扇板 /dev/fanctrl：writev 批量发送，应答按顺序匹配
+class SerialBackend : public FanBackend
+{
+public:
+    const char* Name() const { return "serial"; }
+    int Probe();
+    int WritePwm(FanPwmOp* ops, int opNum);
+    int ReadSysTemp(int* pTemp);
+    int Generation() const { return m_session.ReconnectCount(); }
+    void GetStats(FanBackendStats& stats) const;
+
+private:
+    SerialSession   m_session;
+    char            m_recvBuf[1024];
+};
+
+// aaeon_sio 驱动：长期持有 fd，一批设置在一次 Submit 中连续下发
+// 多个逻辑通道映射到同一个 fan_num 时（各加速卡共用一个风扇），下发各通道需求的最大值
+class IoctlBackend : public FanBackend
+{
+public:
+    // channelMap[i] 为逻辑通道 i 对应的 fan_num，-1 表示该通道不由本后端控制
+    IoctlBackend(const std::vector<int>& channelMap, const char* configPath);
+    const char* Name() const { return "ioctl"; }
+    int Probe();
+    int WritePwm(FanPwmOp* ops, int opNum);
+    int ReadSysTemp(int* pTemp);
+    bool Controls(int channel) const;
+    int TakeStaleChannels(int* channels, int maxNum);
+    int Generation() const { return m_dev.ReopenCount(); }
+
+private:
+    int FanDemand(int fanNum) const;
+
+    SioDevice           m_dev;
+    std::vector<int>    m_channelMap;
+    SysfsReader         m_sysTemp;
+    int                 m_fanAck[SIO_FAN_MAX];                  //交给 SioDevice 的确认地址，抽查不一致时被清 0
+    int                 m_fanPwm[SIO_FAN_MAX];                  //各风扇已确认的值，-1 表示未知
+    int                 m_demand[FAN_BACKEND_CHANNEL_NUM];      //各逻辑通道最近一次要求的值
+    bool                m_stale[FAN_BACKEND_CHANNEL_NUM];
+    int                 m_reopenSeen;
+};
+
+// 通用 hwmon 芯片：/sys/class/hwmon/hwmonX/pwmN，取值 0~255，fd 长期持有
+// 只在配置中显式指定芯片名和通道映射时使用，退出时恢复各 pwmN_enable 的原值
+class HwmonBackend : public FanBackend
+{
+public:
+    // chipName 为 hwmonX/name 中的芯片名；channelMap[i] 为逻辑通道 i 对应的 pwm 编号，0 或负数表示不控制
+    HwmonBackend(const std::string& chipName, const std::vector<int>& channelMap);
+    ~HwmonBackend();
+    const char* Name() const { return "hwmon"; }
+    int Probe();
+    int WritePwm(FanPwmOp* ops, int opNum);
+    int ReadSysTemp(int* pTemp);
+    bool Controls(int channel) const;
+    void GetStats(FanBackendStats& stats) const;
+
+private:
+    std::string         m_chipName;
+    std::string         m_chipPath;
+    std::vector<int>    m_channelMap;
+    int                 m_pwmFd[FAN_BACKEND_CHANNEL_NUM];
+    std::string         m_enableOrig[FAN_BACKEND_CHANNEL_NUM];     //接管前的 pwmN_enable，空表示没有改过
+    SysfsReader         m_chipTemp;
+    SysfsReader         m_sysTemp;
+    long long           m_writeErrCnt;
+};
+
+// 读取配置文件的 "backend" 节点，按指定类型或 ioctl、serial 的探测顺序选择后端
+// 自动探测时只把完成读写验证的后端写入 FAN_BACKEND_CACHE_PATH；没有任何后端可用时返回空指针
+std::unique_ptr<FanBackend> CreateFanBackend(const char* configPath);
+
+#endif // __FAN_BACKEND_H__
@@ -0,0 +1,317 @@
+// 风扇板模拟器：在 pty 上模拟 /dev/fanctrl 的 $FxS / !GTP / #GPV / @GSV 协议
+// 用法：FanBoardSim [-l 链接路径] [-d 应答延迟ms] [-j 抖动ms] [-x 丢字节概率] [-m 满转转速] [-c 转速时间常数s] [-t 主板温度] [-p cpu功耗]
+// 然后以 FANCTRL_DEV=<pty 或链接路径> 运行 AutoFanCtrl / ManFanCtrl
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <cmath>
+#include <chrono>
+#include <deque>
+#include <random>
+#include <string>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+#define SIM_CHANNEL_NUM     10
+#define SIM_TICK_MS         50
+
+struct SimConfig
+{
+    string  linkPath;
+    int     latencyMs = 2;
+    int     jitterMs = 0;
+    double  dropRate = 0;
+    int     maxRpm = 6000;
+    double  rpmTau = 2.0;
+    int     sysTemp = 40;
+    int     cpuPower = 65;
+};
+
+struct PendingReply
+{
+    long long   dueUs;
+    string      data;
+};
+
+struct SimStats
+{
+    long long   cmdCnt = 0;
+    long long   badByteCnt = 0;
+    long long   dropByteCnt = 0;
+};
+
+static volatile sig_atomic_t    s_stop = 0;
+static SimConfig                s_cfg;
+static SimStats                 s_stats;
+static int                      s_pwm[SIM_CHANNEL_NUM] = {0};
+static double                   s_rpm[SIM_CHANNEL_NUM] = {0};
+static mt19937                  s_rng(12345);
+
+static long long NowUs()
+{
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void OnSignal(int sig)
+{
+    s_stop = 1;
+}
+
+static int GetHelp()
+{
+    cout << "FanBoardSim [-l link_path] [-d latency_ms] [-j jitter_ms] [-x drop_rate] [-m max_rpm] [-c rpm_tau_s] [-t sys_temp] [-p cpu_power]" << endl;
+    cout << "Then run: FANCTRL_DEV=<pty path> AutoFanCtrl" << endl;
+    return 0;
+}
+
+static int ParseArgs(int argc, char* argv[])
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        string opt = argv[i];
+        if(opt == "-h")
+        {
+            GetHelp();
+            exit(0);
+        }
+
+        if(i + 1 >= argc)
+        {
+            cout << "[ERROR] Missing value for " << opt << endl;
+            return -1;
+        }
+
+        const char* value = argv[++i];
+        if(opt == "-l")         s_cfg.linkPath = value;
+        else if(opt == "-d")    s_cfg.latencyMs = atoi(value);
+        else if(opt == "-j")    s_cfg.jitterMs = atoi(value);
+        else if(opt == "-x")    s_cfg.dropRate = atof(value);
+        else if(opt == "-m")    s_cfg.maxRpm = atoi(value);
+        else if(opt == "-c")    s_cfg.rpmTau = atof(value);
+        else if(opt == "-t")    s_cfg.sysTemp = atoi(value);
+        else if(opt == "-p")    s_cfg.cpuPower = atoi(value);
+        else
+        {
+            cout << "[ERROR] Unknown option " << opt << endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// 转速按一阶惯性逼近 pwm 对应的目标转速
+static void UpdateRpm(double dtSec)
+{
+    double alpha = s_cfg.rpmTau > 0 ? 1 - exp(-dtSec / s_cfg.rpmTau) : 1;
+
+    for(int i = 0; i < SIM_CHANNEL_NUM; ++i)
+    {
+        double target = (double)s_cfg.maxRpm * s_pwm[i] / 100;
+        s_rpm[i] += (target - s_rpm[i]) * alpha;
+    }
+}
+
+static void QueueReply(deque<PendingReply>& replies, const string& data)
+{
+    long long delayUs = (long long)s_cfg.latencyMs * 1000;
+    if(s_cfg.jitterMs > 0)
+    {
+        delayUs += uniform_int_distribution<long long>(0, (long long)s_cfg.jitterMs * 1000)(s_rng);
+    }
+
+    // 应答保持发送顺序
+    long long due = NowUs() + delayUs;
+    if(!replies.empty() && due < replies.back().dueUs)
+    {
+        due = replies.back().dueUs;
+    }
+
+    replies.push_back({due, data});
+}
+
+// 从接收缓冲区中解析完整命令，返回消耗的字节数
+static size_t HandleInput(const string& rx, deque<PendingReply>& replies)
+{
+    size_t pos = 0;
+
+    while(pos < rx.size())
+    {
+        char head = rx[pos];
+        if(head != '$' && head != '!' && head != '#' && head != '@')
+        {
+            ++s_stats.badByteCnt;
+            ++pos;
+            continue;
+        }
+
+        size_t cmdLen = head == '$' ? 7 : 4;
+        if(rx.size() - pos < cmdLen)
+        {
+            break;
+        }
+
+        string cmd = rx.substr(pos, cmdLen);
+        ++s_stats.cmdCnt;
+
+        if(head == '$')
+        {
+            int channel = cmd[2] - '0';
+            int pwm = atoi(cmd.c_str() + 4);
+            if(cmd[1] != 'F' || cmd[3] != 'S' || channel < 0 || channel >= SIM_CHANNEL_NUM || pwm < 0 || pwm > 100)
+            {
+                QueueReply(replies, cmd + ":ERR\r\n");
+            }
+            else
+            {
+                s_pwm[channel] = pwm;
+                QueueReply(replies, cmd + ":OK\r\n");
+            }
+        }
+        else if(cmd == "!GTP")
+        {
+            QueueReply(replies, cmd + ":" + to_string(s_cfg.sysTemp) + "\r\n");
+        }
+        else if(cmd == "#GPV")
+        {
+            QueueReply(replies, cmd + ":" + to_string(s_cfg.cpuPower) + "\r\n");
+        }
+        else if(cmd == "@GSV")
+        {
+            QueueReply(replies, cmd + ":" + to_string((int)lround(s_rpm[0])) + "\r\n");
+        }
+        else
+        {
+            QueueReply(replies, cmd + ":ERR\r\n");
+        }
+
+        pos += cmdLen;
+    }
+
+    return pos;
+}
+
+static void SendReply(int master, const string& data)
+{
+    string out;
+    uniform_real_distribution<double> dist(0, 1);
+
+    for(char c : data)
+    {
+        if(s_cfg.dropRate > 0 && dist(s_rng) < s_cfg.dropRate)
+        {
+            ++s_stats.dropByteCnt;
+            continue;
+        }
+
+        out.push_back(c);
+    }
+
+    if(!out.empty() && write(master, out.data(), out.size()) < 0)
+    {
+        perror("write");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if(ParseArgs(argc, argv) != 0)
+    {
+        GetHelp();
+        return -1;
+    }
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if(master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        perror("posix_openpt");
+        return -1;
+    }
+
+    const char* slavePath = ptsname(master);
+
+    // 自己持有一个 slave fd，客户端断开重连时 master 不会收到 HUP；同时设为原始模式
+    int slave = open(slavePath, O_RDWR | O_NOCTTY);
+    struct termios options;
+    if(slave < 0 || tcgetattr(slave, &options) != 0)
+    {
+        perror("open slave");
+        return -1;
+    }
+    cfmakeraw(&options);
+    tcsetattr(slave, TCSANOW, &options);
+
+    if(!s_cfg.linkPath.empty())
+    {
+        unlink(s_cfg.linkPath.c_str());
+        if(symlink(slavePath, s_cfg.linkPath.c_str()) != 0)
+        {
+            perror("symlink");
+            return -1;
+        }
+    }
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    cout << "FanBoardSim ready on " << slavePath;
+    if(!s_cfg.linkPath.empty())
+    {
+        cout << " (" << s_cfg.linkPath << ")";
+    }
+    cout << ", latency " << s_cfg.latencyMs << " ms, jitter " << s_cfg.jitterMs << " ms, drop rate " << s_cfg.dropRate << endl;
+
+    deque<PendingReply>     replies;
+    string                  rx;
+    long long               lastTick = NowUs();
+    char                    buf[256];
+
+    while(!s_stop)
+    {
+        long long now = NowUs();
+        int wait = SIM_TICK_MS;
+        if(!replies.empty())
+        {
+            wait = (int)max(0LL, min((long long)SIM_TICK_MS, (replies.front().dueUs - now + 999) / 1000));
+        }
+
+        struct pollfd pfd = {master, POLLIN, 0};
+        int ret = poll(&pfd, 1, wait);
+        if(ret > 0 && (pfd.revents & POLLIN))
+        {
+            int n = read(master, buf, sizeof(buf));
+            if(n > 0)
+            {
+                rx.append(buf, n);
+                rx.erase(0, HandleInput(rx, replies));
+            }
+        }
+
+        now = NowUs();
+        while(!replies.empty() && replies.front().dueUs <= now)
+        {
+            SendReply(master, replies.front().data);
+            replies.pop_front();
+        }
+
+        UpdateRpm((now - lastTick) / 1e6);
+        lastTick = now;
+    }
+
+    cout << "FanBoardSim exit, commands: " << s_stats.cmdCnt << ", bad bytes: " << s_stats.badByteCnt
+         << ", dropped bytes: " << s_stats.dropByteCnt << endl;
+    if(!s_cfg.linkPath.empty())
+    {
+        unlink(s_cfg.linkPath.c_str());
+    }
+    close(slave);
+    close(master);
+    return 0;
+}
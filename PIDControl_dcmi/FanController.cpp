@@ -1,5 +1,8 @@
 #include "FanController.h"
+#include "FanProtocol.h"
+#include "SampleScheduler.h"
 #include "dcmi_interface_api.h"
+#include "json.hpp"
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/file.h>
@@ -53,58 +56,298 @@
 #define DEFAULT_KI 0.5
 #define DEFAULT_KD 0.1
 
+using json = nlohmann::json;
+
+
 int g_cardDangFlag = 0;
+FanChannelTable g_fanTable;
 
 using namespace std;
 using namespace chrono;
 
 
-// 通用小函数
-string Int2StrPadZero(int value, int length)
+// FanChannelTable 成员函数
+FanChannelTable::FanChannelTable()
+    : m_generation(0)
 {
-    string result = to_string(value);
-    if (result.length() < length)
+    for(int i = 0; i < MAX_FAN_CHANNEL_NUM; ++i)
     {
-        result = string(length - result.length(), '0').append(result);
+        m_channels[i].desiredPwm = -1;
+        m_channels[i].ackedPwm = -1;
+        m_channels[i].pAckPwm = NULL;
+        m_channels[i].name[0] = '\0';
+        m_channels[i].uncontrolled = false;
+        m_channels[i].cmdClass = FAN_CMD_CONTROL;
     }
+}
 
-    return result;
+bool FanChannelTable::Set(int channel, int pwm, int* pAckPwm, const char* name, FanCmdClass cmdClass, steady_clock::time_point detectTime)
+{
+    IF_COND_FAIL_FMT(channel >= 0 && channel < MAX_FAN_CHANNEL_NUM && pwm >= 0 && pwm <= FAN_PWM_MAX, return false,
+        "[ERROR] FanChannelTable: Invalid fan command, channel %d, pwm %d.", channel, pwm);
+
+    // 同一周期内多次写同一通道，以最后一次为准
+    Channel& ch = m_channels[channel];
+    ch.desiredPwm = pwm;
+    ch.pAckPwm = pAckPwm;
+    snprintf(ch.name, sizeof(ch.name), "%s", name);
+
+    // 未发出的紧急命令不会被同通道的普通命令降级
+    if(cmdClass < ch.cmdClass)
+    {
+        ch.cmdClass = cmdClass;
+        ch.detectTime = detectTime;
+    }
+
+    // 风扇板上已经是这个值，不需要再发
+    if(pwm == ch.ackedPwm)
+    {
+        if(pAckPwm != NULL)
+        {
+            *pAckPwm = pwm;
+        }
+        ch.pAckPwm = NULL;
+        ch.cmdClass = FAN_CMD_CONTROL;
+    }
+
+    return true;
 }
 
-int ExecCommand(int serialFd, const char* cmd, char* recvBuf, int recvBufLen)
+void FanChannelTable::Invalidate()
 {
-    IF_COND_FAIL(serialFd != 0, "[ERROR] Serial port /dev/fanctrl is not open.", return -1;);
+    for(int i = 0; i < MAX_FAN_CHANNEL_NUM; ++i)
+    {
+        m_channels[i].ackedPwm = -1;
+    }
+}
 
-    int ret = write(serialFd, cmd, strlen(cmd));
-    IF_COND_FAIL(ret >= 0, (string("[ERROR] Failed to write the command. cmd: ") + cmd).data(), return ret;);
+bool FanChannelTable::HasPending(FanCmdClass maxClass) const
+{
+    for(int i = 0; i < MAX_FAN_CHANNEL_NUM; ++i)
+    {
+        const Channel& ch = m_channels[i];
+        if(ch.desiredPwm >= 0 && ch.desiredPwm != ch.ackedPwm && ch.cmdClass <= maxClass)
+        {
+            return true;
+        }
+    }
 
-    usleep(100000); //100ms
-    memset(recvBuf, 0, recvBufLen);
+    return false;
+}
 
-    ret = read(serialFd, recvBuf, recvBufLen);
-    IF_COND_FAIL(ret >= 0, (string("[ERROR] Failed to read the result. cmd: ") + cmd).data(), return ret;);
+int FanChannelTable::Flush(FanBackend& backend, FanCmdClass maxClass)
+{
+    int         acked = 0;
+    int         opNum = 0;
+    FanPwmOp    ops[MAX_FAN_CHANNEL_NUM];
 
-    return 0;
+    // 后端重连后风扇可能已复位，已确认的值都不再可信
+    if(backend.Generation() != m_generation)
+    {
+        m_generation = backend.Generation();
+        Invalidate();
+    }
+
+    // 按优先级从高到低排入本批命令
+    for(int cmdClass = FAN_CMD_EMERGENCY; cmdClass <= maxClass; ++cmdClass)
+    {
+        for(int i = 0; i < MAX_FAN_CHANNEL_NUM; ++i)
+        {
+            Channel& ch = m_channels[i];
+            if(ch.desiredPwm < 0 || ch.desiredPwm == ch.ackedPwm || ch.cmdClass != cmdClass)
+            {
+                continue;
+            }
+
+            // 后端没有对应风扇的通道丢弃本次设置，不发送、不计入确认和紧急统计
+            if(!backend.Controls(i))
+            {
+                if(!ch.uncontrolled)
+                {
+                    syslog(LOG_INFO, "[INFO] %s fan is not controlled by backend %s, skip it.", ch.name, backend.Name());
+                    ch.uncontrolled = true;
+                }
+                ch.desiredPwm = -1;
+                ch.pAckPwm = NULL;
+                ch.cmdClass = FAN_CMD_CONTROL;
+                continue;
+            }
+            ch.uncontrolled = false;
+
+            ops[opNum].channel = i;
+            ops[opNum].pwm = ch.desiredPwm;
+            ops[opNum].acked = false;
+            ++opNum;
+        }
+    }
+
+    if(opNum == 0)
+    {
+        return 0;
+    }
+
+    backend.WritePwm(ops, opNum);
+
+    // 后端发现之前确认过的值已不在风扇上，清掉确认值，下次 Flush 重发
+    int staleList[MAX_FAN_CHANNEL_NUM];
+    int staleNum = backend.TakeStaleChannels(staleList, MAX_FAN_CHANNEL_NUM);
+    for(int i = 0; i < staleNum; ++i)
+    {
+        m_channels[staleList[i]].ackedPwm = -1;
+    }
+
+    for(int i = 0; i < opNum; ++i)
+    {
+        Channel& ch = m_channels[ops[i].channel];
+
+        // 未确认的通道保持待发状态，下次 Flush 重发
+        if(!ops[i].acked)
+        {
+            syslog(LOG_INFO, "[ERROR] Fail to set %s pwm !!! backend: %s, pwm: %d.", ch.name, backend.Name(), ops[i].pwm);
+            continue;
+        }
+
+        ++acked;
+        ch.ackedPwm = ch.desiredPwm;
+        if(ch.pAckPwm != NULL)
+        {
+            *ch.pAckPwm = ch.desiredPwm;
+            ch.pAckPwm = NULL;
+        }
+
+        if(ch.cmdClass == FAN_CMD_EMERGENCY)
+        {
+            double costMs = duration<double, milli>(steady_clock::now() - ch.detectTime).count();
+            ++m_emergencyStats.count;
+            m_emergencyStats.lastMs = costMs;
+            m_emergencyStats.maxMs = max(m_emergencyStats.maxMs, costMs);
+            m_emergencyStats.totalMs += costMs;
+            syslog(LOG_INFO, "[INFO] %s emergency pwm %d actuated %.1f ms after detection.", ch.name, ch.desiredPwm, costMs);
+        }
+        ch.cmdClass = FAN_CMD_CONTROL;
+
+        syslog(LOG_INFO, "[INFO] Set %s pwm success, current pwm: %d", ch.name, ch.desiredPwm);
+    }
+
+    return acked == opNum ? 0 : -1;
+}
+
+
+PidProfile BuiltinPidProfile(PidRole role, const string& product)
+{
+    PidProfile profile = {DEFAULT_KP, DEFAULT_KI, DEFAULT_KD, PWM_MIN, PWM_MAX, TARGET_TEMP, CARD_MIN_TEMP, SAFE_TEMP, CRITICAL_TEMP};
+
+    if(role == PID_ROLE_CPU)
+    {
+        profile.kp = CPU_KP;
+        profile.ki = CPU_KI;
+        profile.kd = CPU_KD;
+    }
+    else if(role == PID_ROLE_MAINBOARD)
+    {
+        profile.kp = SYS_KP;
+        profile.ki = SYS_KI;
+        profile.kd = SYS_KD;
+    }
+    else if(product == "Atlas 300I Duo")
+    {
+        profile.kp = THRIDUO_KP;
+        profile.ki = THRIDUO_KI;
+        profile.kd = THRIDUO_KD;
+    }
+    else if(product == "Atlas 300I Pro")
+    {
+        profile.kp = THRIPRO_KP;
+        profile.ki = THRIPRO_KI;
+        profile.kd = THRIPRO_KD;
+    }
+    else if(product == "Atlas 300V")
+    {
+        profile.kp = THRV_KP;
+        profile.ki = THRV_KI;
+        profile.kd = THRV_KD;
+    }
+
+    return profile;
+}
+
+static void MergePidProfile(const json& node, PidProfile& profile)
+{
+    if(!node.is_object())
+    {
+        return;
+    }
+
+    profile.kp = node.value("kp", profile.kp);
+    profile.ki = node.value("ki", profile.ki);
+    profile.kd = node.value("kd", profile.kd);
+    profile.pwmMin = node.value("pwm_min", profile.pwmMin);
+    profile.pwmMax = node.value("pwm_max", profile.pwmMax);
+    profile.targetTemp = node.value("target_temp", profile.targetTemp);
+    profile.minTemp = node.value("min_temp", profile.minTemp);
+    profile.safeTemp = node.value("safe_temp", profile.safeTemp);
+    profile.criticalTemp = node.value("critical_temp", profile.criticalTemp);
+}
+
+PidProfile LoadPidProfile(const char* path, PidRole role, const string& product)
+{
+    const char* roleNames[] = {"cpu", "mainboard", "cards"};
+    PidProfile  builtin = BuiltinPidProfile(role, product);
+    PidProfile  profile = builtin;
+
+    ifstream file(path);
+    json root = json::parse(file, nullptr, false);
+    if(root.is_discarded() || !root.is_object() || !root.contains("pid") || !root["pid"].is_object() || !root["pid"].contains(roleNames[role]))
+    {
+        return builtin;
+    }
+
+    // 类型不对时 json 抛异常，整组按不合法处理
+    try
+    {
+        const json& node = root["pid"][roleNames[role]];
+        if(role != PID_ROLE_CARD)
+        {
+            MergePidProfile(node, profile);
+        }
+        else if(node.is_object())
+        {
+            MergePidProfile(node.value("default", json()), profile);
+            MergePidProfile(node.value(product, json()), profile);
+        }
+    }
+    catch(const json::exception& e)
+    {
+        syslog(LOG_INFO, "[ERROR] LoadPidProfile: pid.%s %s: %s, use builtin.", roleNames[role], product.c_str(), e.what());
+        return builtin;
+    }
+
+    bool valid = profile.kp >= 0 && profile.ki >= 0 && profile.kd >= 0
+        && profile.pwmMin >= 0 && profile.pwmMin <= profile.pwmMax && profile.pwmMax <= FAN_PWM_MAX
+        && profile.targetTemp < profile.safeTemp && profile.safeTemp < profile.criticalTemp;
+    IF_COND_FAIL_FMT(valid, return builtin, "[ERROR] LoadPidProfile: Invalid pid.%s %s, use builtin.", roleNames[role], product.c_str());
+
+    return profile;
 }
 
 
 // FanController 成员函数
-FanController::FanController(int fd)
-    : m_kp(0), m_ki(0), m_kd(0), m_integral(0), m_curPwm(0), m_fd(fd)
+FanController::FanController(FanBackend* pBackend)
+    : m_kp(0), m_ki(0), m_kd(0), m_integral(0), m_pBackend(pBackend), m_curPwm(0), m_emergencyFlag(false), m_deadlineMs(-1),
+      m_profile(BuiltinPidProfile(PID_ROLE_CARD, "")), m_slope(0), m_slopeRef{0, steady_clock::time_point()}, m_periodMs(0), m_stableCnt(0)
 {
     m_prevError = 0;
     m_lastTime = steady_clock::now();
     m_criticalFlag = false;
-    memset(m_recvBuf, 0, MAX_RECV_BUF_SIZE);
 }
 
-FanController::FanController(double kp, double ki, double kd, double integral, int fd)
-    : m_kp(kp), m_ki(ki), m_kd(kd), m_integral(integral), m_curPwm(0), m_fd(fd)
+FanController::FanController(double kp, double ki, double kd, double integral, FanBackend* pBackend)
+    : m_kp(kp), m_ki(ki), m_kd(kd), m_integral(integral), m_pBackend(pBackend), m_curPwm(0), m_emergencyFlag(false), m_deadlineMs(-1),
+      m_profile{kp, ki, kd, PWM_MIN, PWM_MAX, TARGET_TEMP, CARD_MIN_TEMP, SAFE_TEMP, CRITICAL_TEMP}, m_slope(0), m_slopeRef{0, steady_clock::time_point()}, m_periodMs(0), m_stableCnt(0)
 {
     m_prevError = 0;
     m_lastTime = steady_clock::now();
     m_criticalFlag = false;
-    memset(m_recvBuf, 0, MAX_RECV_BUF_SIZE);
 }
 
 void FanController::SetPidParams(double kp, double ki, double kd, double integral)
@@ -115,16 +358,26 @@ void FanController::SetPidParams(double kp, double ki, double kd, double integra
     m_integral = integral;
 }
 
-void FanController::Restart(int fd) 
+void FanController::SetProfile(const PidProfile& profile)
+{
+    // ki * integral 不变，切换增益时积分项对输出的贡献保持连续
+    double integral = profile.ki > 0 ? m_integral * m_ki / profile.ki : 0;
+
+    m_profile = profile;
+    SetPidParams(profile.kp, profile.ki, profile.kd, integral);
+}
+
+void FanController::Restart() 
 {
-    m_fd = fd;
     m_integral = 0;
     m_prevError = 0;
     m_curPwm = 0;
     m_lastTime = steady_clock::now();
     m_criticalFlag = false;
     g_cardDangFlag = 0;
-    memset(m_recvBuf, 0, MAX_RECV_BUF_SIZE);
+    m_slope = 0;
+    m_slopeRef.time = steady_clock::time_point();
+    m_stableCnt = 0;
 }
 
 void FanController::Reset()
@@ -133,7 +386,73 @@ void FanController::Reset()
     m_prevError = 0;
     m_lastTime = steady_clock::now();
     m_criticalFlag = false;
-    memset(m_recvBuf, 0, MAX_RECV_BUF_SIZE);
+}
+
+void FanController::UpdateSlope(const TempSample& sample)
+{
+    if(m_slopeRef.time == steady_clock::time_point())
+    {
+        m_slopeRef = sample;
+        return;
+    }
+
+    double dt = duration<double>(sample.time - m_slopeRef.time).count();
+    if(dt * 1000 < SLOPE_WINDOW_MS)
+    {
+        return;
+    }
+
+    m_slope = (sample.temp - m_slopeRef.temp) / dt;
+    m_slopeRef = sample;
+}
+
+int FanController::NextPeriodMs(const AdaptivePeriod& adaptive)
+{
+    if(!adaptive.enable)
+    {
+        return adaptive.baseMs;
+    }
+
+    if(m_periodMs <= 0)
+    {
+        m_periodMs = adaptive.baseMs;
+    }
+
+    // 低于目标温度且风扇已在最低转速时偏差再大也无需调节
+    bool errorHigh = m_prevError >= adaptive.errorHigh || (m_prevError <= -adaptive.errorHigh && m_curPwm > m_profile.pwmMin);
+    if(m_criticalFlag || fabs(m_slope) >= adaptive.slopeHigh || errorHigh)
+    {
+        m_stableCnt = 0;
+        m_periodMs = adaptive.minMs;
+    }
+    else if(fabs(m_slope) < adaptive.slopeHigh / 4)
+    {
+        if(++m_stableCnt >= SAMPLE_STABLE_ROUNDS)
+        {
+            m_periodMs = min(max(m_periodMs * 3 / 2, adaptive.baseMs), adaptive.maxMs);
+        }
+    }
+    else
+    {
+        m_stableCnt = 0;
+        m_periodMs = adaptive.baseMs;
+    }
+
+    return m_periodMs;
+}
+
+void FanController::MarkEmergency()
+{
+    m_emergencyFlag = true;
+    m_detectTime = steady_clock::now();
+}
+
+FanCmdClass FanController::TakeCmdClass()
+{
+    FanCmdClass cmdClass = m_emergencyFlag ? FAN_CMD_EMERGENCY : FAN_CMD_CONTROL;
+
+    m_emergencyFlag = false;
+    return cmdClass;
 }
 
 int FanController::CalcPwm(int& curTemp)
@@ -149,16 +468,22 @@ int FanController::CalcPwm(int& curTemp)
         return 100;
     }
 
-    curTemp = ReadTemp();
+    TempSample sample = ReadTemp();
+    curTemp = sample.temp;
+    UpdateSlope(sample);
 
-    if(curTemp > CRITICAL_TEMP)
+    if(curTemp > m_profile.criticalTemp)
     {
+        if(!m_criticalFlag)
+        {
+            MarkEmergency();
+        }
         m_criticalFlag = true;
     }
 
     if(m_criticalFlag)
     {
-        if(curTemp < SAFE_TEMP)
+        if(curTemp < m_profile.safeTemp)
         {
             m_criticalFlag = false;
             Reset();
@@ -169,158 +494,187 @@ int FanController::CalcPwm(int& curTemp)
         }
     }
 
-    auto now = steady_clock::now();
-    duration<double> dtDuration = now - m_lastTime;
+    duration<double> dtDuration = sample.time - m_lastTime;
     double dt = dtDuration.count();
     dt = max(dt, 0.001);
-    double error = curTemp - TARGET_TEMP;
+    double error = curTemp - m_profile.targetTemp;
     m_integral += error * dt;
     double derivative = (error - m_prevError) / dt;
     double output = m_kp * error + m_ki * m_integral + m_kd * derivative;
     int pwm = static_cast<int>(round(output));
-    pwm = max(PWM_MIN, min(pwm, PWM_MAX));
-    if (pwm != static_cast<int>(round(output))) {
+    pwm = max(m_profile.pwmMin, min(pwm, m_profile.pwmMax));
+    if (pwm != static_cast<int>(round(output)) && m_ki > 0) {
         m_integral = (pwm - m_kp * error - m_kd * derivative) / m_ki;
     }
     
     m_prevError = error;
-    m_lastTime = now;
+    m_lastTime = sample.time;
     return pwm;
 }
 
 
 // CPUController 成员函数
-CPUController::CPUController(int fd)
-    : FanController(CPU_KP, CPU_KI, CPU_KD, CPU_INTEGRAL, fd) 
+CPUController::CPUController(FanBackend* pBackend)
+    : FanController(CPU_KP, CPU_KI, CPU_KD, CPU_INTEGRAL, pBackend), m_sensors("cpu"), m_worker("cpu")
 {
     // SetPwm();
 }
 
-int CPUController::ReadTemp()
+int CPUController::LoadSensors(const vector<SensorInfo>& sensors, const char* configPath)
 {
-    int cpuTemp = CRITICAL_TEMP;
+    if(m_sensors.Load(sensors, configPath, SENSOR_CPU) == 0)
+    {
+        m_sensors.AddSensor("thermal_zone0", CPU_TEMP_FILE_PATH);
+    }
+
+    // 之后 m_sensors 只在工作线程中访问
+    m_worker.Start([this](int* pTemp) { return m_sensors.Read(pTemp); });
+    return 0;
+}
+
+TempSample CPUController::ReadTemp()
+{
+    TempSample      sample = {m_profile.criticalTemp, steady_clock::now()};
+    WorkerReading   reading = m_worker.Sample(m_deadlineMs < 0 ? SAMPLE_CPU_DEADLINE_MS : m_deadlineMs);
 
-    ifstream file(CPU_TEMP_FILE_PATH); 
-    if(file.is_open())
+    // 偶尔超时沿用上一次的结果，连续超时按读取失败处理
+    if(reading.ret != 0 || reading.staleRounds >= SENSOR_STALE_LIMIT)
     {
-        string content;
-        getline(file, content);
-        cpuTemp = stoi(content) / 1000;
-        file.close();
+        syslog(LOG_INFO, "[ERROR] Fail to read cpu temperature, set temper is %d", m_profile.criticalTemp);
+        return sample;
     }
 
-    return cpuTemp;
+    sample.temp = reading.value;
+    sample.time = reading.time;
+    return sample;
 }
 
 void CPUController::SetPwm()
 {
     int         pwm = 0;
     int         curTemp = 0;
-    int         ret = -1;
-    string      cmd;
-    vector<int> busIdVec;
+    int         busIdNum = 0;
+    int         busIdList[MAX_CARD_FAN_NUM] = {0};
+    char        name[32] = {0};
 
     pwm = CalcPwm(curTemp);
+    FanCmdClass cmdClass = TakeCmdClass();
     if(m_curPwm == pwm)
     {
         return;
     }
 
-    cmd = "$F0S" + Int2StrPadZero(pwm, 3);
-    ret = ExecCommand(m_fd, cmd.data(), m_recvBuf, MAX_RECV_BUF_SIZE);
-    IF_COND_FAIL(ret == 0, "[ERROR] Fail to set cpu pwm !!!", return;);
+    g_fanTable.Set(0, pwm, &m_curPwm, "cpu", cmdClass, m_detectTime);
 
     // 检查 cardlist
-    busIdVec = g_params.getBusIdVec();
-    for(auto it = busIdVec.begin(); it != busIdVec.end(); ++it) 
+    busIdNum = g_params.getBusIdList(busIdList, MAX_CARD_FAN_NUM);
+    for(int index = 0; index < busIdNum; ++index) 
     {
-        if(*it == -1)
+        snprintf(name, sizeof(name), "AI_CARD%d", index + 1);
+
+        if(busIdList[index] == -1)
         {
-            int index = it - busIdVec.begin();
-            cmd = cmd = "$F" + to_string(index + 2) + "S030";
-            ret = ExecCommand(m_fd, cmd.data(), m_recvBuf, MAX_RECV_BUF_SIZE);
-            IF_COND_FAIL(ret == 0, ("[ERROR] Fail to set AI_CARD" + to_string(index + 1) + " pwm !!!").data(), continue;);
-            
-            syslog(LOG_INFO, "[INFO] Set AI_CARD%d pwm success, current pwm: 30", index + 1);
-            // cout << "[INFO] Set AI_CARD" << index + 1 << " pwm success, current pwm: 30" << endl;
+            g_fanTable.Set(index + 2, 30, NULL, name);
         }
-        else if(*it == -2)
+        else if(busIdList[index] == -2)
         {
-            int index = it - busIdVec.begin();
-            cmd = "$F" + to_string((it - busIdVec.begin()) + 2) + "S" + Int2StrPadZero(pwm, 3);
-            ret = ExecCommand(m_fd, cmd.data(), m_recvBuf, MAX_RECV_BUF_SIZE);
-            IF_COND_FAIL(ret == 0, ("[ERROR] Fail to set AI_CARD" + to_string(index + 1) + " pwm !!!").data(), continue;);
-
-            syslog(LOG_INFO, "[INFO] Set AI_CARD%d pwm success, current pwm: %d", index + 1, pwm);
-            // cout << "[INFO] Set AI_CARD" << index + 1 << " pwm success, current pwm: " << pwm << endl;
-            m_curPwm = pwm;
+            g_fanTable.Set(index + 2, pwm, NULL, name, cmdClass, m_detectTime);
         }
     }
 
-    m_curPwm = pwm;
+    // 紧急命令不等周期末尾的批量发送
+    if(cmdClass == FAN_CMD_EMERGENCY)
+    {
+        g_fanTable.Flush(*m_pBackend, FAN_CMD_EMERGENCY);
+    }
+
     syslog(LOG_INFO, "[INFO] cpu temperatrue: %d.", curTemp);
     // cout << "[INFO] cpu temperatrue:" << curTemp << endl;
-    syslog(LOG_INFO, "[INFO] Set cpu pwm success, current pwm: %d", pwm);
-    // cout << "[INFO] Set cpu pwm success, current pwm: " << pwm << endl;
 }
 
 
 // SysController 成员函数
-SysController::SysController(int fd)
-    : FanController(SYS_KP, SYS_KI, SYS_KD, SYS_INTEGRAL, fd) 
+SysController::SysController(FanBackend* pBackend)
+    : FanController(SYS_KP, SYS_KI, SYS_KD, SYS_INTEGRAL, pBackend), m_sensors("mainboard"), m_worker("mainboard") 
 {
     // SetPwm();
 }
 
-int SysController::ReadTemp()
+int SysController::LoadSensors(const vector<SensorInfo>& sensors, const char* configPath)
 {
-    int ret = -1;
-    int sysTemp = 0;
+    m_sensors.Load(sensors, configPath, SENSOR_BOARD);
+    if(!m_sensors.Configured() && strcmp(m_pBackend->Name(), "serial") == 0)
+    {
+        m_sensors.Clear();
+    }
 
-    ret = ExecCommand(m_fd, "!GTP", m_recvBuf, MAX_RECV_BUF_SIZE);
-    IF_COND_FAIL(ret == 0, "[ERROR] SysController.ReadTemp: Fail to read sys temp", return CRITICAL_TEMP;);
+    // 串口 !GTP 与风扇命令共用同一个后端，保持同步查询，由后端的应答超时限定耗时
+    if(!m_sensors.Empty())
+    {
+        m_worker.Start([this](int* pTemp) { return m_sensors.Read(pTemp); });
+    }
 
-    try
+    syslog(LOG_INFO, "[INFO] mainboard temperature source: %s.", m_sensors.Empty() ? m_pBackend->Name() : "sysfs");
+    return 0;
+}
+
+TempSample SysController::ReadTemp()
+{
+    int         sysTemp = m_profile.criticalTemp;
+    TempSample  sample = {m_profile.criticalTemp, steady_clock::now()};
+
+    if(m_worker.Started())
     {
-        sysTemp = stoi(std::string(m_recvBuf).substr(5,2));
+        WorkerReading reading = m_worker.Sample(m_deadlineMs < 0 ? SAMPLE_SYS_DEADLINE_MS : m_deadlineMs);
+        IF_COND_FAIL_FMT(reading.ret == 0 && reading.staleRounds < SENSOR_STALE_LIMIT, return sample,
+            "[ERROR] Fail to read mainboard temperatrue from sysfs, set temper is %d", m_profile.criticalTemp);
+        sample.temp = reading.value;
+        sample.time = reading.time;
+        return sample;
     }
-    catch (const std::invalid_argument& e)
+
+    // 查询让位于待发的紧急命令
+    g_fanTable.Flush(*m_pBackend, FAN_CMD_EMERGENCY);
+
+    // 后端内部已按需重试，仍失败才按临界温度处理
+    if(m_pBackend->ReadSysTemp(&sysTemp) != 0)
     {
-        syslog(LOG_INFO, "[ERROR] Fail to get mainboard temperatrue, stoi error, original temperStr: %s, sub(5,2), set temper is 85", m_recvBuf);
-        sysTemp = CRITICAL_TEMP;
+        syslog(LOG_INFO, "[ERROR] Fail to get mainboard temperatrue from %s backend, set temper is %d", m_pBackend->Name(), m_profile.criticalTemp);
+        return sample;
     }
 
-    return sysTemp;
+    // 以应答到达的时刻为采样时刻
+    sample.temp = sysTemp;
+    sample.time = steady_clock::now();
+    return sample;
 }
 
 void SysController::SetPwm()
 {
     int     pwm = 0;
     int     curTemp = 0;
-    int     ret = -1;
-    string  cmd;
 
     pwm = CalcPwm(curTemp);
+    FanCmdClass cmdClass = TakeCmdClass();
     if(m_curPwm == pwm)
     {
         return;
     }
 
-    cmd = "$F1S" + Int2StrPadZero(pwm, 3);
-    ret = ExecCommand(m_fd, cmd.data(), m_recvBuf, MAX_RECV_BUF_SIZE);
-    IF_COND_FAIL(ret == 0, "[ERROR] Fail to set system pwm !!!", return;);
+    g_fanTable.Set(1, pwm, &m_curPwm, "mainboard", cmdClass, m_detectTime);
+    if(cmdClass == FAN_CMD_EMERGENCY)
+    {
+        g_fanTable.Flush(*m_pBackend, FAN_CMD_EMERGENCY);
+    }
 
-    m_curPwm = pwm;
     syslog(LOG_INFO, "[INFO] mainboard temperatrue: %d.", curTemp);
     // cout << "[INFO] mainboard temperatrue:" << curTemp << endl;
-    syslog(LOG_INFO, "[INFO] Set mainboard pwm success, current pwm: %d", pwm);
-    // cout << "[INFO] Set mainboard pwm success, current pwm: " << pwm << endl;
 }
 
 
 // CardController 成员函数
-CardController::CardController(int fd, int cardId)
-    : FanController(fd), m_cardId(cardId) 
+CardController::CardController(FanBackend* pBackend, int cardId, CardTelemetryPool* pPool)
+    : FanController(pBackend), m_cardId(cardId), m_pPool(pPool), m_faultFlag(false)
 {
     int                         ret = 0;
     char                        product_type_str[64] = {0};
@@ -335,55 +689,73 @@ CardController::CardController(int fd, int cardId)
     IF_COND_FAIL(ret == 0, (string("[ERROR] CardController: Fail to get product type, dcmi_get_product_type error code: ")+to_string(ret)).data(), m_initFlag = false);
     m_proType = product_type_str;
 
-    // set kp,ki,kd
-    if(m_proType == "Atlas 300I Duo")
-    {
-        m_kp = THRIDUO_KP;
-        m_ki = THRIDUO_KI;
-        m_kd = THRIDUO_KD;
-    }
-    else if(m_proType == "Atlas 300I Pro")
+    // set kp,ki,kd，配置文件中的参数由 main 在启动和配置变化时设置
+    SetProfile(BuiltinPidProfile(PID_ROLE_CARD, m_proType));
+}
+
+TempSample CardController::ReadTemp()
+{
+    int         cardTemp = m_profile.criticalTemp;
+    int         ret = -1;
+    CardSample  cardSample;
+    TempSample  sample = {m_profile.criticalTemp, steady_clock::now()};
+
+    // 使用本周期并行查询的快照，采样时刻取该卡查询返回的时间
+    if(m_pPool != NULL && m_pPool->GetSample(m_cardId, cardSample))
     {
-        m_kp = THRIPRO_KP;
-        m_ki = THRIPRO_KI;
-        m_kd = THRIPRO_KD;
+        IF_COND_FAIL_FMT(cardSample.tempRet == 0, return sample, "[ERROR] CardController.ReadTemp: Fail to get Temp, error code is %d", cardSample.tempRet);
+        IF_COND_FAIL_FMT(cardSample.staleRounds < SENSOR_STALE_LIMIT, return sample, "[ERROR] CardController.ReadTemp: card %d stale for %d rounds", m_cardId, cardSample.staleRounds);
+        sample.temp = cardSample.temp;
+        sample.time = cardSample.time;
+        return sample;
     }
-    else if (m_proType == "Atlas 300V")
+
+    // 多芯片卡取最热的芯片
+    int deviceNum = 1;
+    if(dcmi_get_device_num_in_card(m_cardId, &deviceNum) != 0 || deviceNum <= 0)
     {
-        m_kp = THRV_KP;
-        m_ki = THRV_KI;
-        m_kd = THRV_KD;
+        deviceNum = 1;
     }
-    else
+
+    int hotTemp = 0;
+    for(int device = 0; device < deviceNum; ++device)
     {
-        //unkown
-        m_kp = DEFAULT_KP;
-        m_ki = DEFAULT_KI;
-        m_kd = DEFAULT_KD;
+        ret = dcmi_get_device_temperature(m_cardId, device, &cardTemp);
+        IF_COND_FAIL_FMT(ret == 0, return sample, "[ERROR] CardController.ReadTemp: Fail to get device %d Temp, error code is %d", device, ret);
+        hotTemp = device == 0 ? cardTemp : max(hotTemp, cardTemp);
     }
-}
 
-int CardController::ReadTemp()
-{
-    int cardTemp = CRITICAL_TEMP;
-    int ret = -1;
-    
-    ret = dcmi_get_device_temperature(m_cardId, 0, &cardTemp);
-    IF_COND_FAIL(ret == 0, string("[ERROR] CardController.ReadTemp: Fail to get Temp, error code is " + to_string(ret)).data(), return cardTemp);
-
-    return cardTemp;
+    sample.temp = hotTemp;
+    sample.time = steady_clock::now();
+    return sample;
 }
 
 
 int CardController::CalcPwm(int& curTemp)
 {
-    int tarTemp = TARGET_TEMP;
+    int tarTemp = m_profile.targetTemp;
 
-    curTemp = ReadTemp();
+    TempSample sample = ReadTemp();
+    curTemp = sample.temp;
+    UpdateSlope(sample);
+
+    // 故障事件先于温度采样到达，不等温度越过临界温度；退出仍按温度回落到 safeTemp 判断
+    if(m_faultFlag)
+    {
+        m_faultFlag = false;
+        if(!m_criticalFlag)
+        {
+            m_criticalFlag = true;
+            g_cardDangFlag += (m_cardId + 1);
+            MarkEmergency();
+            m_detectTime = m_faultTime;
+        }
+        return 100;
+    }
 
     if(m_criticalFlag)
     {
-        if(curTemp < SAFE_TEMP)
+        if(curTemp < m_profile.safeTemp)
         {
             m_criticalFlag = false;
             g_cardDangFlag -= (m_cardId + 1);
@@ -396,24 +768,25 @@ int CardController::CalcPwm(int& curTemp)
     }
     else
     {
-        if(curTemp > CRITICAL_TEMP)
+        if(curTemp > m_profile.criticalTemp)
         {
             m_criticalFlag = true;
             g_cardDangFlag += (m_cardId + 1);
+            MarkEmergency();
+            return 100;
         }
     }
 
-    if(curTemp < 50)
+    if(curTemp < m_profile.minTemp)
     {
-        tarTemp = CARD_MIN_TEMP;
+        tarTemp = m_profile.minTemp;
     }
-    else if(curTemp < TARGET_TEMP)
+    else if(curTemp < m_profile.targetTemp)
     {
         tarTemp = (curTemp / 10) * 10;
     }
 
-    auto now = steady_clock::now();
-    duration<double> dtDuration = now - m_lastTime;
+    duration<double> dtDuration = sample.time - m_lastTime;
     double dt = dtDuration.count();
     dt = max(dt, 0.001);
     double error = curTemp - tarTemp;
@@ -421,44 +794,63 @@ int CardController::CalcPwm(int& curTemp)
     double derivative = (error - m_prevError) / dt;
     double output = m_kp * error + m_ki * m_integral + m_kd * derivative;
     int pwm = static_cast<int>(round(output));
-    pwm = max(PWM_MIN, min(pwm, PWM_MAX));
-    if (pwm != static_cast<int>(round(output))) {
+    pwm = max(m_profile.pwmMin, min(pwm, m_profile.pwmMax));
+    if (pwm != static_cast<int>(round(output)) && m_ki > 0) {
         m_integral = (pwm - m_kp * error - m_kd * derivative) / m_ki;
     }
     
     m_prevError = error;
-    m_lastTime = now;
+    m_lastTime = sample.time;
     return pwm;
 }
 
+void CardController::ForceCritical(steady_clock::time_point eventTime)
+{
+    m_faultFlag = true;
+    m_faultTime = eventTime;
+}
+
 void CardController::SetPwm()
 {
     int         pwm = 0;
     int         curTemp = 0;
-    int         ret = -1;
-    string      cmd;
-    vector<int> busIdVec;
+    int         busIdNum = 0;
+    int         busIdList[MAX_CARD_FAN_NUM] = {0};
+    char        name[96] = {0};
 
     pwm = CalcPwm(curTemp);
+    FanCmdClass cmdClass = TakeCmdClass();
+
+    // 加速卡超温时 cpu、主板风扇同时全速，不等各自的控制周期
+    if(cmdClass == FAN_CMD_EMERGENCY)
+    {
+        g_fanTable.Set(0, 100, NULL, "cpu", cmdClass, m_detectTime);
+        g_fanTable.Set(1, 100, NULL, "mainboard", cmdClass, m_detectTime);
+    }
+
     if(m_curPwm == pwm)
     {
+        if(cmdClass == FAN_CMD_EMERGENCY)
+        {
+            g_fanTable.Flush(*m_pBackend, FAN_CMD_EMERGENCY);
+        }
         return;
     }
 
-    busIdVec = g_params.getBusIdVec();
-    for(auto it = busIdVec.begin(); it != busIdVec.end(); ++it) 
+    busIdNum = g_params.getBusIdList(busIdList, MAX_CARD_FAN_NUM);
+    for(int index = 0; index < busIdNum; ++index) 
     {
-        if(*it == m_busId)
+        if(busIdList[index] == m_busId)
         {
-            cmd = "$F" + to_string((it - busIdVec.begin()) + 2) + "S" + Int2StrPadZero(pwm, 3);
-            ret = ExecCommand(m_fd, cmd.data(), m_recvBuf, MAX_RECV_BUF_SIZE);
-            IF_COND_FAIL(ret == 0, ("[ERROR] Fail to set " + m_proType + " pwm !!!").data(), continue;);
-            m_curPwm = pwm;
+            snprintf(name, sizeof(name), "%s(bus_id %d)", m_proType.data(), m_busId);
+            g_fanTable.Set(index + 2, pwm, &m_curPwm, name, cmdClass, m_detectTime);
             
             syslog(LOG_INFO, "[INFO] %s card_id is %d, temperatrue: %d.", m_proType.data(), m_cardId, curTemp);
             // cout << "[INFO] " << m_proType << " card_id is " << m_cardId << ", temperatrue:" << curTemp << endl;
-            syslog(LOG_INFO, "[INFO] Set %s pwm success, bus_is is %d, current pwm: %d", m_proType.data(), m_busId, pwm);
-            // cout << "[INFO] Set " << m_proType << " pwm success, bus_id is " << m_busId << ", current pwm: " << pwm << endl;
         }
     }
+    if(cmdClass == FAN_CMD_EMERGENCY)
+    {
+        g_fanTable.Flush(*m_pBackend, FAN_CMD_EMERGENCY);
+    }
 }
\ No newline at end of file
@@ -6,9 +6,20 @@
 #include <string>
 #include <shared_mutex>
 #include <mutex>
+#include <algorithm>
+#include "FanBackend.h"
+#include "CardTelemetry.h"
+#include "TempSensors.h"
+#include "SensorWorker.h"
+#include "SampleScheduler.h"
 
 #define MAX_RECV_BUF_SIZE   1024
+#define MAX_CARD_FAN_NUM    8
+#define MAX_FAN_CHANNEL_NUM (MAX_CARD_FAN_NUM + 2)  // cpu、主板、各加速卡
 #define MODE_FILE_PATH  "/etc/FanControlParams.json"
+#define STATS_FILE_PATH "/run/FanControlStats.json"
+#define STATS_PERIOD_S  5
+#define SLOPE_WINDOW_MS 2000
 #define _PRINT_SYS_LOG
 // log 默认是 char*
 #ifdef _PRINT_SYS_LOG
@@ -29,6 +40,25 @@
         } while (0)
 #endif //_PRINT_SYS_LOG
 
+// 格式化版本，失败路径上不拼接 std::string
+#ifdef _PRINT_SYS_LOG
+    #define IF_COND_FAIL_FMT(cond, todo, fmt, ...) \
+        do { \
+            if (!(cond)) { \
+                syslog(LOG_INFO, fmt, ##__VA_ARGS__); \
+                todo; \
+            } \
+        } while (0)
+#else
+    #define IF_COND_FAIL_FMT(cond, todo, fmt, ...) \
+        do { \
+            if (!(cond)) { \
+                fprintf(stderr, fmt "\n", ##__VA_ARGS__); \
+                todo; \
+            } \
+        } while (0)
+#endif //_PRINT_SYS_LOG
+
 struct GlobalParams 
 {
     bool                autoFlag = false;
@@ -53,18 +83,122 @@ struct GlobalParams
         std::unique_lock<std::shared_mutex> lock(mutex);
         return cardBusIdVec;
     }
+
+    // 拷贝到调用方的数组，控制周期内不分配内存
+    int getBusIdList(int* busIdList, int maxNum)
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        int num = std::min((int)cardBusIdVec.size(), maxNum);
+        std::copy(cardBusIdVec.begin(), cardBusIdVec.begin() + num, busIdList);
+        return num;
+    }
 };
 
 extern GlobalParams             g_params;
 
+// 命令优先级：紧急全速 > 周期控制 > 诊断查询
+enum FanCmdClass
+{
+    FAN_CMD_EMERGENCY,
+    FAN_CMD_CONTROL,
+    FAN_CMD_DIAG,
+};
+
+// 从检测到超温到风扇板确认全速的耗时统计
+struct EmergencyStats
+{
+    int     count = 0;
+    double  lastMs = 0;
+    double  maxMs = 0;
+    double  totalMs = 0;
+};
+
+// 风扇通道影子寄存器：控制周期内各控制器只写表，同一通道以最后一次写入为准；
+// Flush 时只把与上次确认值不同的通道作为一批交给后端
+class FanChannelTable
+{
+public:
+    FanChannelTable();
+    // pAckPwm 非空时，该值被风扇板确认后写入 pwm；紧急命令的 detectTime 用于统计响应耗时
+    bool Set(int channel, int pwm, int* pAckPwm, const char* name,
+        FanCmdClass cmdClass = FAN_CMD_CONTROL,
+        std::chrono::steady_clock::time_point detectTime = std::chrono::steady_clock::time_point());
+    // 风扇状态未知时（手动模式结束、后端重连）清空确认值，下次 Flush 全部重发
+    void Invalidate();
+    // 发送优先级不低于 maxClass 的待发通道，高优先级先发
+    int Flush(FanBackend& backend, FanCmdClass maxClass = FAN_CMD_DIAG);
+    bool HasPending(FanCmdClass maxClass) const;
+    const EmergencyStats& GetEmergencyStats() const { return m_emergencyStats; }
+
+private:
+    struct Channel
+    {
+        int     desiredPwm;
+        int     ackedPwm;
+        int*    pAckPwm;
+        char    name[32];
+        bool    uncontrolled;
+        FanCmdClass                             cmdClass;
+        std::chrono::steady_clock::time_point   detectTime;
+    };
+
+    Channel         m_channels[MAX_FAN_CHANNEL_NUM];
+    int             m_generation;
+    EmergencyStats  m_emergencyStats;
+};
+
+extern FanChannelTable          g_fanTable;
+
+// 一次温度采样，time 为读到数据的时刻，PID 的 dt 按相邻两次采样的时间计算
+struct TempSample
+{
+    int                                     temp;
+    std::chrono::steady_clock::time_point   time;
+};
+
+// 控制器角色，决定 "pid" 节点中使用哪一组参数
+enum PidRole
+{
+    PID_ROLE_CPU,
+    PID_ROLE_MAINBOARD,
+    PID_ROLE_CARD,
+};
+
+// PID 增益和温度、转速限值
+struct PidProfile
+{
+    double  kp;
+    double  ki;
+    double  kd;
+    int     pwmMin;
+    int     pwmMax;
+    int     targetTemp;
+    int     minTemp;        //加速卡低于 50°C 时的目标温度
+    int     safeTemp;       //超温后回落到该温度以下才恢复 PID 控制
+    int     criticalTemp;
+};
+
+// 编译时的缺省参数，加速卡按 dcmi_get_product_type 的字符串区分
+PidProfile BuiltinPidProfile(PidRole role, const std::string& product);
+// 来自 /etc/FanControlParams.json 的 "pid" 节点："cpu"、"mainboard"、"cards"，cards 下按型号字符串取，未列出的型号用 "default"
+// 缺失的字段依次沿用 "default" 和内置值；整组不合法时使用内置值
+PidProfile LoadPidProfile(const char* path, PidRole role, const std::string& product);
+
 class FanController
 {
 public:
-    FanController(int fd);
-    FanController(double kp, double ki, double kd, double integral, int fd);
-    void Restart(int fd);
+    FanController(FanBackend* pBackend);
+    FanController(double kp, double ki, double kd, double integral, FanBackend* pBackend);
+    void Restart();
     virtual void SetPwm() = 0;
     void SetPidParams(double kp, double ki, double kd, double integral);
+    // 运行中替换参数：积分项按 ki 换算，输出不跳变
+    void SetProfile(const PidProfile& profile);
+    const PidProfile& Profile() const { return m_profile; }
+    // 下一次采样最多等待的时间，超时使用上一次的结果
+    void SetDeadline(int deadlineMs) { m_deadlineMs = deadlineMs; }
+    // 按最近的温度变化率和 PID 偏差给出下一次采样的周期
+    int NextPeriodMs(const AdaptivePeriod& adaptive);
 
 protected:
     double                                              m_kp;
@@ -72,47 +206,80 @@ protected:
     double                                              m_kd;
     double                                              m_integral;
     double                                              m_prevError;
-    std::chrono::time_point<std::chrono::steady_clock>  m_lastTime;
-    int                                                 m_curTemp;
-    int                                                 m_fd;
-    char                                                m_recvBuf[MAX_RECV_BUF_SIZE];
+    std::chrono::time_point<std::chrono::steady_clock>  m_lastTime;       //上一次参与计算的采样时刻
+    FanBackend*                                         m_pBackend;
     bool                                                m_criticalFlag;
     int                                                 m_curPwm;
+    bool                                                m_emergencyFlag;
+    std::chrono::time_point<std::chrono::steady_clock>  m_detectTime;
+    int                                                 m_deadlineMs;
+    PidProfile                                          m_profile;
+    double                                              m_slope;            //°C/s
+    TempSample                                          m_slopeRef;         //计算变化率的起点
+    int                                                 m_periodMs;
+    int                                                 m_stableCnt;
 
-    virtual int ReadTemp() = 0;
+    virtual TempSample ReadTemp() = 0;
     virtual int CalcPwm(int& curTemp);
     void Reset();
+    // 每次读到温度后调用，变化率按至少 SLOPE_WINDOW_MS 的间隔计算，避免 1°C 的量化跳变被放大
+    void UpdateSlope(const TempSample& sample);
+    // 刚越过临界温度时记录检测时间，本周期的命令按紧急优先级发送
+    void MarkEmergency();
+    FanCmdClass TakeCmdClass();
 };
 
 class CPUController : public FanController
 {
 public:
-    CPUController(int fd);
+    CPUController(FanBackend* pBackend);
     void SetPwm();
+    // 按 "sensors".cpu 配置或类型选择传感器，都没有时使用 thermal_zone0
+    int LoadSensors(const std::vector<SensorInfo>& sensors, const char* configPath);
+    // 未使用 sysfs 传感器时为空
+    const SensorWorker* Worker() const { return m_worker.Started() ? &m_worker : NULL; }
 
 protected:
-    int ReadTemp();
+    TempSample ReadTemp();
+
+private:
+    TempSensorGroup m_sensors;
+    SensorWorker    m_worker;
 };
 
 class SysController : public FanController
 {
 public:
-    SysController(int fd);
+    SysController(FanBackend* pBackend);
     void SetPwm();
+    // 按 "sensors".mainboard 配置或类型选择传感器，没有选中时由后端读取主板温度
+    // 串口风扇板自带温度传感器，只有显式配置时才改用 sysfs
+    int LoadSensors(const std::vector<SensorInfo>& sensors, const char* configPath);
+    // 未使用 sysfs 传感器时为空
+    const SensorWorker* Worker() const { return m_worker.Started() ? &m_worker : NULL; }
 
 protected:
-    int ReadTemp();
+    TempSample ReadTemp();
+
+private:
+    TempSensorGroup m_sensors;
+    SensorWorker    m_worker;
 };
 
 class CardController : public FanController
 {
 public:
-    CardController(int fd, int cardId);
+    // pPool 为空时每次直接调用 dcmi 查询温度
+    CardController(FanBackend* pBackend, int cardId, CardTelemetryPool* pPool = NULL);
     void SetPwm();
+    // 收到温度类故障事件，下一次 SetPwm 直接按超温处理，检测时刻取事件到达时间
+    void ForceCritical(std::chrono::steady_clock::time_point eventTime);
+    int CardId() const { return m_cardId; }
+    const std::string& ProductType() const { return m_proType; }
 
 protected:
     int CalcPwm(int& curTemp);
-    int ReadTemp();
+    TempSample ReadTemp();
 
 private:
     bool                                                m_initFlag;
@@ -120,6 +287,9 @@ private:
     bool                                                m_fullFlag;
     int                                                 m_busId;
     std::string                                         m_proType;
+    CardTelemetryPool*                                  m_pPool;
+    bool                                                m_faultFlag;
+    std::chrono::time_point<std::chrono::steady_clock>  m_faultTime;
 };
 
 #endif // __FAN_CONTROLLER_H__
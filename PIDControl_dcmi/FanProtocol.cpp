@@ -0,0 +1,224 @@
+#include "FanProtocol.h"
+#include <string.h>
+
+// 0~100 的三位补零文本，编译期生成
+struct PwmDigitTable
+{
+    char digits[FAN_PWM_MAX + 1][3];
+
+    constexpr PwmDigitTable() : digits()
+    {
+        for(int i = 0; i <= FAN_PWM_MAX; ++i)
+        {
+            digits[i][0] = '0' + i / 100;
+            digits[i][1] = '0' + i / 10 % 10;
+            digits[i][2] = '0' + i % 10;
+        }
+    }
+};
+
+static constexpr PwmDigitTable  s_pwmTable;
+static const char*              s_queryCmd[] = {"!GTP", "#GPV", "@GSV"};
+static const char*              s_statusStr[] = {"ok", "partial", "garbled", "out of range", "rejected"};
+
+#define REPLY_ECHO_LEN      4
+#define REPLY_MAX_DIGITS    6
+#define TEMP_MIN            -40
+#define TEMP_MAX            150
+#define POWER_MAX           1000000
+#define SPEED_MAX           30000
+#define SET_PWM_ECHO_LEN    7
+
+int EncodeSetPwm(char* buf, int bufLen, int channel, int pwm)
+{
+    if(bufLen < FAN_CMD_BUF_SIZE || channel < 0 || channel > FAN_CHANNEL_MAX || pwm < 0 || pwm > FAN_PWM_MAX)
+    {
+        return -1;
+    }
+
+    buf[0] = '$';
+    buf[1] = 'F';
+    buf[2] = '0' + channel;
+    buf[3] = 'S';
+    memcpy(buf + 4, s_pwmTable.digits[pwm], 3);
+    buf[7] = '\0';
+    return 7;
+}
+
+int EncodeQuery(char* buf, int bufLen, FanQuery query)
+{
+    if(bufLen < 5 || query < FAN_QUERY_TEMP || query > FAN_QUERY_SPEED)
+    {
+        return -1;
+    }
+
+    memcpy(buf, s_queryCmd[query], 5);
+    return 4;
+}
+
+// 在 buf 中找到 query 的回显，取回显后的第一个整数
+static FanReplyStatus ParseReplyValue(const char* buf, int len, FanQuery query, int* pValue)
+{
+    const char* echo = s_queryCmd[query];
+    int         pos = 0;
+
+    // 跳过回显前残留的空白和 '\0'
+    while(pos < len && (buf[pos] == '\0' || buf[pos] == '\r' || buf[pos] == '\n' || buf[pos] == ' '))
+    {
+        ++pos;
+    }
+
+    for(int i = 0; i < REPLY_ECHO_LEN; ++i, ++pos)
+    {
+        if(pos >= len)
+        {
+            return FAN_REPLY_PARTIAL;
+        }
+
+        if(buf[pos] != echo[i])
+        {
+            return FAN_REPLY_GARBLED;
+        }
+    }
+
+    // 回显与数值之间最多两个分隔符，如 ':'、'='、空格
+    for(int i = 0; i < 2 && pos < len && buf[pos] != '\0' && buf[pos] != '-' && (buf[pos] < '0' || buf[pos] > '9'); ++i)
+    {
+        ++pos;
+    }
+
+    bool negative = false;
+    if(pos < len && buf[pos] == '-')
+    {
+        negative = true;
+        ++pos;
+    }
+
+    int value = 0;
+    int digits = 0;
+    for(; pos < len && buf[pos] >= '0' && buf[pos] <= '9'; ++pos)
+    {
+        if(++digits > REPLY_MAX_DIGITS)
+        {
+            return FAN_REPLY_GARBLED;
+        }
+
+        value = value * 10 + (buf[pos] - '0');
+    }
+
+    if(digits == 0)
+    {
+        return pos >= len || buf[pos] == '\0' ? FAN_REPLY_PARTIAL : FAN_REPLY_GARBLED;
+    }
+
+    // 数值后只允许出现单位、空白或行尾
+    if(pos < len && buf[pos] != '\0' && buf[pos] != '\r' && buf[pos] != '\n' && buf[pos] != ' '
+        && buf[pos] != 'C' && buf[pos] != 'W' && buf[pos] != 'R')
+    {
+        return FAN_REPLY_GARBLED;
+    }
+
+    *pValue = negative ? -value : value;
+    return FAN_REPLY_OK;
+}
+
+FanReplyStatus ParseTempReply(const char* buf, int len, FanTempReply* pReply)
+{
+    pReply->temp = 0;
+    pReply->status = ParseReplyValue(buf, len, FAN_QUERY_TEMP, &pReply->temp);
+    if(pReply->status == FAN_REPLY_OK && (pReply->temp < TEMP_MIN || pReply->temp > TEMP_MAX))
+    {
+        pReply->status = FAN_REPLY_RANGE;
+    }
+
+    return pReply->status;
+}
+
+FanReplyStatus ParsePowerReply(const char* buf, int len, FanPowerReply* pReply)
+{
+    pReply->power = 0;
+    pReply->status = ParseReplyValue(buf, len, FAN_QUERY_POWER, &pReply->power);
+    if(pReply->status == FAN_REPLY_OK && (pReply->power < 0 || pReply->power > POWER_MAX))
+    {
+        pReply->status = FAN_REPLY_RANGE;
+    }
+
+    return pReply->status;
+}
+
+FanReplyStatus ParseSpeedReply(const char* buf, int len, FanSpeedReply* pReply)
+{
+    pReply->rpm = 0;
+    pReply->status = ParseReplyValue(buf, len, FAN_QUERY_SPEED, &pReply->rpm);
+    if(pReply->status == FAN_REPLY_OK && (pReply->rpm < 0 || pReply->rpm > SPEED_MAX))
+    {
+        pReply->status = FAN_REPLY_RANGE;
+    }
+
+    return pReply->status;
+}
+
+FanReplyStatus ParseSetPwmReply(const char* buf, int len, FanSetPwmReply* pReply)
+{
+    int pos = 0;
+
+    pReply->channel = -1;
+    pReply->pwm = -1;
+
+    // 跳过回显前残留的空白和 '\0'
+    while(pos < len && (buf[pos] == '\0' || buf[pos] == '\r' || buf[pos] == '\n' || buf[pos] == ' '))
+    {
+        ++pos;
+    }
+
+    if(len - pos < SET_PWM_ECHO_LEN)
+    {
+        pReply->status = FAN_REPLY_PARTIAL;
+        return pReply->status;
+    }
+
+    const char* echo = buf + pos;
+    bool digits = echo[2] >= '0' && echo[2] <= '9';
+    for(int i = 4; i < SET_PWM_ECHO_LEN; ++i)
+    {
+        digits = digits && echo[i] >= '0' && echo[i] <= '9';
+    }
+
+    if(echo[0] != '$' || echo[1] != 'F' || echo[3] != 'S' || !digits)
+    {
+        pReply->status = FAN_REPLY_GARBLED;
+        return pReply->status;
+    }
+
+    pReply->channel = echo[2] - '0';
+    pReply->pwm = (echo[4] - '0') * 100 + (echo[5] - '0') * 10 + (echo[6] - '0');
+    if(pReply->pwm > FAN_PWM_MAX)
+    {
+        pReply->status = FAN_REPLY_RANGE;
+        return pReply->status;
+    }
+
+    // 回显之后到行尾为止出现 ERR 即为拒绝
+    pos += SET_PWM_ECHO_LEN;
+    for(; pos + 2 < len && buf[pos] != '\0' && buf[pos] != '\n'; ++pos)
+    {
+        if(buf[pos] == 'E' && buf[pos + 1] == 'R' && buf[pos + 2] == 'R')
+        {
+            pReply->status = FAN_REPLY_REJECTED;
+            return pReply->status;
+        }
+    }
+
+    pReply->status = FAN_REPLY_OK;
+    return pReply->status;
+}
+
+const char* FanReplyStatusStr(FanReplyStatus status)
+{
+    if(status < FAN_REPLY_OK || status > FAN_REPLY_REJECTED)
+    {
+        return "unknown";
+    }
+
+    return s_statusStr[status];
+}
@@ -0,0 +1,63 @@
+#ifndef __FAN_PROTOCOL_H__
+#define __FAN_PROTOCOL_H__
+
+// 风扇板串口协议编解码，全部使用调用方提供的定长缓冲区，不做堆分配
+#define FAN_CMD_BUF_SIZE    8       // "$F9S100" + '\0'
+#define FAN_CHANNEL_MAX     9
+#define FAN_PWM_MAX         100
+
+enum FanQuery
+{
+    FAN_QUERY_TEMP,                 // !GTP 主板温度
+    FAN_QUERY_POWER,                // #GPV cpu 功耗
+    FAN_QUERY_SPEED,                // @GSV cpu 风扇转速
+};
+
+enum FanReplyStatus
+{
+    FAN_REPLY_OK,
+    FAN_REPLY_PARTIAL,              // 帧不完整：回显或数值还没收全，可重发
+    FAN_REPLY_GARBLED,              // 帧内容错乱：回显不匹配或数值中有非法字符
+    FAN_REPLY_RANGE,                // 数值超出合理范围
+    FAN_REPLY_REJECTED,             // 风扇板回复 ERR，命令未执行
+};
+
+struct FanTempReply
+{
+    FanReplyStatus  status;
+    int             temp;           // 单位：摄氏度
+};
+
+struct FanPowerReply
+{
+    FanReplyStatus  status;
+    int             power;
+};
+
+struct FanSpeedReply
+{
+    FanReplyStatus  status;
+    int             rpm;
+};
+
+struct FanSetPwmReply
+{
+    FanReplyStatus  status;
+    int             channel;
+    int             pwm;
+};
+
+// 编码 $F<ch>S<pwm>，pwm 固定三位补零；成功返回命令长度，参数非法或缓冲区不足返回 -1
+int EncodeSetPwm(char* buf, int bufLen, int channel, int pwm);
+// 编码查询命令 !GTP / #GPV / @GSV，返回命令长度
+int EncodeQuery(char* buf, int bufLen, FanQuery query);
+
+// 解析应答，格式为 回显 + 分隔符 + 数值，如 "!GTP:45\r\n"；buf 不要求以 '\0' 结尾
+FanReplyStatus ParseTempReply(const char* buf, int len, FanTempReply* pReply);
+FanReplyStatus ParsePowerReply(const char* buf, int len, FanPowerReply* pReply);
+FanReplyStatus ParseSpeedReply(const char* buf, int len, FanSpeedReply* pReply);
+// 解析 $F<ch>S<pwm> 的应答，如 "$F2S050:OK\r\n"；回显后带 ERR 时为 FAN_REPLY_REJECTED
+FanReplyStatus ParseSetPwmReply(const char* buf, int len, FanSetPwmReply* pReply);
+const char* FanReplyStatusStr(FanReplyStatus status);
+
+#endif // __FAN_PROTOCOL_H__
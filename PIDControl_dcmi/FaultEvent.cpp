@@ -0,0 +1,269 @@
+#include "FaultEvent.h"
+#include "json.hpp"
+#include <syslog.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+
+using namespace std;
+using namespace chrono;
+using json = nlohmann::json;
+
+FaultEventMonitor* FaultEventMonitor::s_pInstance = NULL;
+
+FaultEventConfig LoadFaultEventConfig(const char* path)
+{
+    FaultEventConfig config;
+
+    ifstream file(path);
+    json root = json::parse(file, nullptr, false);
+    if(root.is_discarded() || !root.is_object() || !root.contains("fault_events") || !root["fault_events"].is_object())
+    {
+        return config;
+    }
+
+    const json& node = root["fault_events"];
+    if(node.contains("enable") && node["enable"].is_boolean())
+    {
+        config.enable = node["enable"];
+    }
+
+    if(node.contains("keywords") && node["keywords"].is_array())
+    {
+        config.keywords.clear();
+        for(auto it = node["keywords"].begin(); it != node["keywords"].end(); ++it)
+        {
+            if(it->is_string())
+            {
+                string keyword = it->get<string>();
+                transform(keyword.begin(), keyword.end(), keyword.begin(), ::tolower);
+                config.keywords.push_back(keyword);
+            }
+        }
+    }
+
+    if(node.contains("event_ids") && node["event_ids"].is_array())
+    {
+        for(auto it = node["event_ids"].begin(); it != node["event_ids"].end(); ++it)
+        {
+            if(it->is_number_unsigned())
+            {
+                config.eventIds.push_back(it->get<unsigned int>());
+            }
+        }
+    }
+
+    return config;
+}
+
+
+// FaultEventMonitor 成员函数
+FaultEventMonitor::FaultEventMonitor()
+    : m_stop(false), m_eventCnt(0), m_matchCnt(0)
+{
+
+}
+
+FaultEventMonitor::~FaultEventMonitor()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    // dcmi_get_fault_event 最多阻塞 FAULT_POLL_TIMEOUT_MS
+    if(m_pollThread.joinable())
+    {
+        m_pollThread.join();
+    }
+
+    if(s_pInstance == this)
+    {
+        s_pInstance = NULL;
+    }
+}
+
+int FaultEventMonitor::Start(const int* cardList, int cardNum, const FaultEventConfig& config, Notify notify)
+{
+    struct dcmi_event_filter filter;
+    int                      subNum = 0;
+
+    m_config = config;
+    m_notify = notify;
+    if(!m_config.enable)
+    {
+        syslog(LOG_INFO, "[INFO] FaultEventMonitor: disabled by config.");
+        return 0;
+    }
+
+    s_pInstance = this;
+
+    // 不在驱动侧过滤，事件名在回调中匹配；多芯片卡（如 300I Duo）每个芯片单独订阅
+    memset(&filter, 0, sizeof(filter));
+    for(int i = 0; i < cardNum; ++i)
+    {
+        int deviceNum = 0;
+        int ret = dcmi_get_device_num_in_card(cardList[i], &deviceNum);
+        if(ret != 0 || deviceNum <= 0)
+        {
+            syslog(LOG_INFO, "[ERROR] FaultEventMonitor: card %d dcmi_get_device_num_in_card fail, ret %d, use device 0 only.", cardList[i], ret);
+            deviceNum = 1;
+        }
+        deviceNum = min(deviceNum, FAULT_MAX_DEVICE_NUM);
+
+        for(int device = 0; device < deviceNum; ++device)
+        {
+            ret = dcmi_subscribe_fault_event(cardList[i], device, filter, Callback);
+            if(ret == 0)
+            {
+                ++subNum;
+                continue;
+            }
+
+            syslog(LOG_INFO, "[ERROR] FaultEventMonitor: card %d device %d subscribe fail, ret %d, fall back to dcmi_get_fault_event.",
+                cardList[i], device, ret);
+            m_pollDevices.push_back(make_pair(cardList[i], device));
+        }
+    }
+
+    if(!m_pollDevices.empty())
+    {
+        m_pollThread = thread(&FaultEventMonitor::PollLoop, this);
+    }
+
+    syslog(LOG_INFO, "[INFO] FaultEventMonitor: %d devices subscribed, %d devices polled.", subNum, (int)m_pollDevices.size());
+    return 0;
+}
+
+void FaultEventMonitor::Callback(struct dcmi_event* event)
+{
+    if(s_pInstance != NULL && event != NULL)
+    {
+        s_pInstance->OnEvent(*event, -1);
+    }
+}
+
+bool FaultEventMonitor::Match(const struct dcmi_dms_fault_event& event) const
+{
+    if(find(m_config.eventIds.begin(), m_config.eventIds.end(), event.event_id) != m_config.eventIds.end())
+    {
+        return true;
+    }
+
+    string name(event.event_name, strnlen(event.event_name, sizeof(event.event_name)));
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    for(auto it = m_config.keywords.begin(); it != m_config.keywords.end(); ++it)
+    {
+        if(!it->empty() && name.find(*it) != string::npos)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FaultEventMonitor::OnEvent(const struct dcmi_event& event, int cardHint)
+{
+    FaultNotice notice;
+
+    if(event.type != DCMI_DMS_FAULT_EVENT)
+    {
+        return;
+    }
+
+    const struct dcmi_dms_fault_event& dms = event.event_t.dms_event;
+    notice.time = steady_clock::now();
+    notice.eventId = dms.event_id;
+    notice.cardId = cardHint;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        ++m_eventCnt;
+    }
+
+    // 只处理告警产生，告警恢复由温度回落后的正常控制处理
+    if(dms.assertion == 0 || !Match(dms))
+    {
+        syslog(LOG_INFO, "[INFO] FaultEventMonitor: ignore event 0x%x %s, assertion %d.", dms.event_id, dms.event_name, dms.assertion);
+        return;
+    }
+
+    if(notice.cardId < 0)
+    {
+        int deviceId = 0;
+        if(dcmi_get_card_id_device_id_from_phyid(&notice.cardId, &deviceId, dms.deviceid) != 0)
+        {
+            notice.cardId = -1;
+        }
+    }
+
+    syslog(LOG_INFO, "[ERROR] FaultEventMonitor: card %d event 0x%x %s, severity %d.", notice.cardId, dms.event_id, dms.event_name, dms.severity);
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        ++m_matchCnt;
+        m_pending.push_back(notice);
+    }
+
+    if(m_notify)
+    {
+        m_notify();
+    }
+}
+
+void FaultEventMonitor::PollLoop()
+{
+    struct dcmi_event_filter filter;
+
+    memset(&filter, 0, sizeof(filter));
+    while(true)
+    {
+        for(auto it = m_pollDevices.begin(); it != m_pollDevices.end(); ++it)
+        {
+            {
+                lock_guard<mutex> lock(m_mutex);
+                if(m_stop)
+                {
+                    return;
+                }
+            }
+
+            struct dcmi_event event;
+            memset(&event, 0, sizeof(event));
+            int     timeoutMs = max(FAULT_POLL_TIMEOUT_MS / (int)m_pollDevices.size(), 1);
+            auto    deadline = steady_clock::now() + milliseconds(timeoutMs);
+            if(dcmi_get_fault_event(it->first, it->second, timeoutMs, filter, &event) == 0)
+            {
+                OnEvent(event, it->first);
+                continue;
+            }
+
+            // 接口不支持时会立即返回错误，补足等待时间避免空转
+            this_thread::sleep_until(deadline);
+        }
+    }
+}
+
+vector<FaultNotice> FaultEventMonitor::Take()
+{
+    vector<FaultNotice> notices;
+
+    lock_guard<mutex> lock(m_mutex);
+    notices.swap(m_pending);
+    return notices;
+}
+
+long long FaultEventMonitor::EventCount() const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    return m_eventCnt;
+}
+
+long long FaultEventMonitor::MatchCount() const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    return m_matchCnt;
+}
@@ -0,0 +1,72 @@
+#ifndef __FAULT_EVENT_H__
+#define __FAULT_EVENT_H__
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "dcmi_interface_api.h"
+
+#define FAULT_POLL_TIMEOUT_MS   200     //订阅不可用时 dcmi_get_fault_event 的单次等待时间
+#define FAULT_MAX_DEVICE_NUM    4       //每张卡最多订阅的芯片数
+
+// 来自 /etc/FanControlParams.json 的 "fault_events" 节点
+// 事件名包含任一关键字（不区分大小写）或 event_id 在列表中的才触发紧急处理
+struct FaultEventConfig
+{
+    bool                        enable = true;
+    std::vector<std::string>    keywords = {"temp", "thermal", "overheat", "fan"};
+    std::vector<unsigned int>   eventIds;
+};
+
+FaultEventConfig LoadFaultEventConfig(const char* path);
+
+// 一张卡上报的温度/风扇类故障
+struct FaultNotice
+{
+    int                                     cardId;     //-1 表示无法对应到卡，按所有卡处理
+    unsigned int                            eventId;
+    std::chrono::steady_clock::time_point   time;
+};
+
+// 在每张卡上订阅 dcmi 故障事件，命中的事件放入待处理队列并立即通知主循环
+// 订阅失败的卡改由后台线程调用 dcmi_get_fault_event 等待
+class FaultEventMonitor
+{
+public:
+    typedef std::function<void()> Notify;
+
+    FaultEventMonitor();
+    ~FaultEventMonitor();
+
+    // 进程内只有一个实例接收 dcmi 回调
+    int Start(const int* cardList, int cardNum, const FaultEventConfig& config, Notify notify);
+    // 取出并清空待处理的故障
+    std::vector<FaultNotice> Take();
+
+    long long EventCount() const;
+    long long MatchCount() const;
+
+private:
+    static void Callback(struct dcmi_event* event);
+    void OnEvent(const struct dcmi_event& event, int cardHint);
+    bool Match(const struct dcmi_dms_fault_event& event) const;
+    void PollLoop();
+
+    FaultEventConfig            m_config;
+    Notify                      m_notify;
+    mutable std::mutex          m_mutex;
+    std::vector<FaultNotice>    m_pending;
+    std::vector<std::pair<int, int>>    m_pollDevices;  // 订阅失败、改为轮询的 (card_id, device_id)
+    std::thread                 m_pollThread;
+    bool                        m_stop;
+    long long                   m_eventCnt;
+    long long                   m_matchCnt;
+
+    static FaultEventMonitor*   s_pInstance;
+};
+
+#endif // __FAULT_EVENT_H__
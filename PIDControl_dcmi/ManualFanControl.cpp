@@ -9,6 +9,7 @@
 #include <string.h>
 #include "dcmi_interface_api.h"
 #include "SerialPort.h"
+#include "FanProtocol.h"
 #include "json.hpp"
 
 using json = nlohmann::json;
@@ -18,6 +19,7 @@ using namespace std;
 #define MAX_RECV_BUF_SIZE   1024
 #define MODE_FILE_PATH  "/etc/FanControlParams.json"
 #define CPU_TEMP_FILE_PATH "/sys/class/thermal/thermal_zone0/temp"
+#define CMD_REPLY_TIMEOUT_MS 500
 
 #define IF_COND_FAIL(cond, log, todo) \
     do \
@@ -33,13 +35,10 @@ int ExecCommand(int serialFd, const char* cmd, char* recvBuf, int recvBufLen)
 {
     IF_COND_FAIL(serialFd != 0, "[ERROR] Serial port /dev/fanctrl is not open.", return -1;);
 
-    int ret = write(serialFd, cmd, strlen(cmd));
-    IF_COND_FAIL(ret >= 0, (string("[ERROR] Failed to write the command. cmd: ") + cmd), return ret;);
+    int ret = SerialWrite(serialFd, cmd, strlen(cmd));
+    IF_COND_FAIL(ret == 0, (string("[ERROR] Failed to write the command. cmd: ") + cmd), return ret;);
 
-    usleep(500000); //500ms
-    memset(recvBuf, 0, recvBufLen);
-
-    ret = read(serialFd, recvBuf, recvBufLen);
+    ret = SerialReadFrame(serialFd, recvBuf, recvBufLen, CMD_REPLY_TIMEOUT_MS);
     IF_COND_FAIL(ret >= 0, (string("[ERROR] Failed to read the result. cmd: ") + cmd), return ret;);
 
     return 0;
@@ -48,9 +47,10 @@ int ExecCommand(int serialFd, const char* cmd, char* recvBuf, int recvBufLen)
 
 int GetTemper(const int fd)
 {
-    string  result;
-    string  content;
-    char    recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    string          result;
+    string          content;
+    char            recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    FanTempReply    tempReply;
     int     device_count = 0;
     int     card_id_list[8] = {0};
     int     ret = 0;
@@ -68,8 +68,10 @@ CPU_END:
 
     ret = ExecCommand(fd, "!GTP", recvBuf, MAX_RECV_BUF_SIZE);
     IF_COND_FAIL(ret == 0, "[ERROR] Failed to get mainboard temperature.", goto SYS_END);
+    IF_COND_FAIL(ParseTempReply(recvBuf, strnlen(recvBuf, MAX_RECV_BUF_SIZE), &tempReply) == FAN_REPLY_OK,
+        string("[ERROR] Invalid mainboard temperature reply(") + FanReplyStatusStr(tempReply.status) + "): " + recvBuf, goto SYS_END);
 
-    cout << "Mainboard Temperature:" << recvBuf << endl;
+    cout << "Mainboard Temperature:" << tempReply.temp << " C\n" << endl;
 
 SYS_END:
     ret = dcmi_init();
@@ -97,8 +99,9 @@ SYS_END:
 
 int GetPower(const int fd)
 {
-    string  result;
-    char    recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    string          result;
+    char            recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    FanPowerReply   powerReply;
     int     device_count = 0;
     int     card_id_list[8] = {0};
     int     ret = 0;
@@ -106,8 +109,10 @@ int GetPower(const int fd)
     
     ret = ExecCommand(fd, "#GPV", recvBuf, MAX_RECV_BUF_SIZE);
     IF_COND_FAIL(ret == 0, "[ERROR] Failed to get cpu power", goto CPU_END);
+    IF_COND_FAIL(ParsePowerReply(recvBuf, strnlen(recvBuf, MAX_RECV_BUF_SIZE), &powerReply) == FAN_REPLY_OK,
+        string("[ERROR] Invalid cpu power reply(") + FanReplyStatusStr(powerReply.status) + "): " + recvBuf, goto CPU_END);
 
-    cout << "CPU Power: \n" << recvBuf << endl;
+    cout << "CPU Power: " << powerReply.power << "\n" << endl;
 
 CPU_END:
     ret = dcmi_init();
@@ -275,13 +280,16 @@ int GetHelp()
 
 int GetCpuFanSpeed(const int fd)
 {
-    int     ret = -1;
-    char    recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    int             ret = -1;
+    char            recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    FanSpeedReply   speedReply;
 
     ret = ExecCommand(fd, "@GSV", recvBuf, MAX_RECV_BUF_SIZE);
     IF_COND_FAIL(ret == 0, "[ERROR] Failed to get cpu fan speed.", return -1);
+    IF_COND_FAIL(ParseSpeedReply(recvBuf, strnlen(recvBuf, MAX_RECV_BUF_SIZE), &speedReply) == FAN_REPLY_OK,
+        string("[ERROR] Invalid cpu fan speed reply(") + FanReplyStatusStr(speedReply.status) + "): " + recvBuf, return -1);
 
-    cout << recvBuf << endl;
+    cout << "CPU Fan Speed: " << speedReply.rpm << " RPM" << endl;
     
     return 0;
 }
@@ -333,13 +341,14 @@ int main(int argc, char *argv[])
     file.close();
     flock(fp, LOCK_UN);
     close(fp);
-    //等待自动程序关闭串口
+    //等待自动程序结束当前周期的收发
     sleep(1);
 
 FILE_OK:
 
-    //初始化串口
+    //初始化串口，链路参数与自动程序使用同一份配置
     int fd = 0, ret = 0;
+    SerialLoadConfig(MODE_FILE_PATH);
     ret = SerialOpen(&fd);
     if(ret != 0)
     {
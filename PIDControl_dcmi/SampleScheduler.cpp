@@ -0,0 +1,339 @@
+#include "SampleScheduler.h"
+#include "json.hpp"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace std;
+using namespace chrono;
+using json = nlohmann::json;
+
+static void LoadMs(const json& node, const char* key, int& valueMs)
+{
+    if(!node.contains(key))
+    {
+        return;
+    }
+
+    if(!node[key].is_number_integer() || node[key].get<int>() < SAMPLE_MIN_PERIOD_MS)
+    {
+        syslog(LOG_INFO, "[ERROR] LoadSampleConfig: Invalid sampling.%s, keep %d ms.", key, valueMs);
+        return;
+    }
+
+    valueMs = node[key].get<int>();
+}
+
+SampleConfig LoadSampleConfig(const char* path)
+{
+    SampleConfig config;
+
+    ifstream file(path);
+    json root = json::parse(file, nullptr, false);
+    if(root.is_discarded() || !root.is_object() || !root.contains("sampling") || !root["sampling"].is_object())
+    {
+        return config;
+    }
+
+    const json& node = root["sampling"];
+    LoadMs(node, "cpu_ms", config.cpuMs);
+    LoadMs(node, "mainboard_ms", config.sysMs);
+    LoadMs(node, "cards_ms", config.cardMs);
+    LoadMs(node, "cpu_deadline_ms", config.cpuDeadlineMs);
+    LoadMs(node, "mainboard_deadline_ms", config.sysDeadlineMs);
+    LoadMs(node, "cards_deadline_ms", config.cardDeadlineMs);
+    LoadMs(node, "cycle_budget_ms", config.budgetMs);
+    LoadMs(node, "cpu_min_ms", config.cpuAdaptive.minMs);
+    LoadMs(node, "cpu_max_ms", config.cpuAdaptive.maxMs);
+    LoadMs(node, "mainboard_min_ms", config.sysAdaptive.minMs);
+    LoadMs(node, "mainboard_max_ms", config.sysAdaptive.maxMs);
+    LoadMs(node, "cards_min_ms", config.cardAdaptive.minMs);
+    LoadMs(node, "cards_max_ms", config.cardAdaptive.maxMs);
+
+    // 配置的基础周期总在上下限之内
+    AdaptivePeriod* adaptives[3] = {&config.cpuAdaptive, &config.sysAdaptive, &config.cardAdaptive};
+    int             baseMs[3] = {config.cpuMs, config.sysMs, config.cardMs};
+    for(int i = 0; i < 3; ++i)
+    {
+        AdaptivePeriod& adaptive = *adaptives[i];
+        adaptive.baseMs = baseMs[i];
+        adaptive.minMs = min(adaptive.minMs, adaptive.baseMs);
+        adaptive.maxMs = max(adaptive.maxMs, adaptive.baseMs);
+        if(node.contains("adaptive") && node["adaptive"].is_boolean())
+        {
+            adaptive.enable = node["adaptive"];
+        }
+        if(node.contains("slope_high") && node["slope_high"].is_number() && node["slope_high"].get<double>() > 0)
+        {
+            adaptive.slopeHigh = node["slope_high"];
+        }
+        if(node.contains("error_high") && node["error_high"].is_number() && node["error_high"].get<double>() > 0)
+        {
+            adaptive.errorHigh = node["error_high"];
+        }
+    }
+
+    syslog(LOG_INFO, "[INFO] LoadSampleConfig: cpu %d/%d ms, mainboard %d/%d ms, cards %d/%d ms, budget %d ms.", config.cpuMs,
+        config.cpuDeadlineMs, config.sysMs, config.sysDeadlineMs, config.cardMs, config.cardDeadlineMs, config.budgetMs);
+    syslog(LOG_INFO, "[INFO] LoadSampleConfig: adaptive %d, cpu %d-%d ms, mainboard %d-%d ms, cards %d-%d ms.", config.cpuAdaptive.enable,
+        config.cpuAdaptive.minMs, config.cpuAdaptive.maxMs, config.sysAdaptive.minMs, config.sysAdaptive.maxMs,
+        config.cardAdaptive.minMs, config.cardAdaptive.maxMs);
+    return config;
+}
+
+
+// SampleScheduler 成员函数
+SampleScheduler::SampleScheduler()
+{
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if(m_timerFd < 0)
+    {
+        syslog(LOG_INFO, "[ERROR] SampleScheduler: timerfd_create fail, errno %d, fall back to poll timeout.", errno);
+    }
+
+    m_wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(m_wakeFd < 0)
+    {
+        syslog(LOG_INFO, "[ERROR] SampleScheduler: eventfd fail, errno %d, Trigger waits for the next due task.", errno);
+    }
+}
+
+SampleScheduler::~SampleScheduler()
+{
+    if(m_timerFd >= 0)
+    {
+        close(m_timerFd);
+    }
+
+    if(m_wakeFd >= 0)
+    {
+        close(m_wakeFd);
+    }
+}
+
+int SampleScheduler::Add(const string& name, int periodMs, int deadlineMs, Task task)
+{
+    Entry entry;
+
+    entry.stats.name = name;
+    entry.stats.periodMs = max(periodMs, SAMPLE_MIN_PERIOD_MS);
+    entry.stats.deadlineMs = deadlineMs > 0 ? deadlineMs : entry.stats.periodMs;
+    entry.task = task;
+    entry.nextDue = steady_clock::now();
+
+    m_entries.push_back(entry);
+    m_triggered.push_back(false);
+    return m_entries.size() - 1;
+}
+
+void SampleScheduler::Restart()
+{
+    auto now = steady_clock::now();
+
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        it->nextDue = now;
+    }
+}
+
+void SampleScheduler::SetPeriod(int id, int periodMs)
+{
+    if(id < 0 || id >= (int)m_entries.size())
+    {
+        return;
+    }
+
+    m_entries[id].stats.periodMs = max(periodMs, SAMPLE_MIN_PERIOD_MS);
+}
+
+void SampleScheduler::Trigger(int id)
+{
+    {
+        lock_guard<mutex> lock(m_wakeMutex);
+        if(id < 0 || id >= (int)m_triggered.size())
+        {
+            return;
+        }
+        m_triggered[id] = true;
+    }
+
+    if(m_wakeFd >= 0)
+    {
+        eventfd_write(m_wakeFd, 1);
+    }
+}
+
+void SampleScheduler::WaitUntil(steady_clock::time_point due)
+{
+    struct pollfd       pfds[2];
+    int                 nfds = 0;
+    int                 timeoutMs = -1;
+    struct itimerspec   spec;
+
+    if(due <= steady_clock::now())
+    {
+        return;
+    }
+
+    // steady_clock 即 CLOCK_MONOTONIC，绝对时刻不受前面任务耗时影响；到期时刻为 0 会解除定时，至少取 1ns
+    memset(&spec, 0, sizeof(spec));
+    nanoseconds ns = max(duration_cast<nanoseconds>(due.time_since_epoch()), nanoseconds(1));
+    spec.it_value.tv_sec = ns.count() / 1000000000;
+    spec.it_value.tv_nsec = ns.count() % 1000000000;
+    if(m_timerFd >= 0 && timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, NULL) == 0)
+    {
+        pfds[nfds++] = {m_timerFd, POLLIN, 0};
+    }
+    else
+    {
+        timeoutMs = (int)ceil(duration<double, milli>(due - steady_clock::now()).count());
+    }
+
+    if(m_wakeFd >= 0)
+    {
+        pfds[nfds++] = {m_wakeFd, POLLIN, 0};
+    }
+
+    while(poll(pfds, nfds, timeoutMs) < 0 && errno == EINTR)
+    {
+    }
+
+    uint64_t value = 0;
+    if(m_timerFd >= 0)
+    {
+        read(m_timerFd, &value, sizeof(value));
+    }
+
+    if(m_wakeFd >= 0)
+    {
+        eventfd_read(m_wakeFd, &value);
+    }
+}
+
+int SampleScheduler::RunOnce()
+{
+    int             runNum = 0;
+    vector<Entry*>  dueEntries;
+    vector<bool>    triggered;
+
+    if(m_entries.empty())
+    {
+        return 0;
+    }
+
+    auto due = m_entries[0].nextDue;
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        due = min(due, it->nextDue);
+    }
+
+    {
+        lock_guard<mutex> lock(m_wakeMutex);
+        if(find(m_triggered.begin(), m_triggered.end(), true) != m_triggered.end())
+        {
+            due = steady_clock::now();
+        }
+    }
+
+    WaitUntil(due);
+    {
+        lock_guard<mutex> lock(m_wakeMutex);
+        triggered = m_triggered;
+        m_triggered.assign(m_triggered.size(), false);
+    }
+
+    // 到期最早的先执行，上一轮推迟的任务因此排在前面；被触发的任务排在最前
+    m_cycleStart = steady_clock::now();
+    for(size_t i = 0; i < m_entries.size(); ++i)
+    {
+        if(triggered[i])
+        {
+            ++m_entries[i].stats.triggerCnt;
+            dueEntries.insert(dueEntries.begin(), &m_entries[i]);
+        }
+        else if(m_entries[i].nextDue <= m_cycleStart)
+        {
+            dueEntries.push_back(&m_entries[i]);
+        }
+    }
+    auto firstDue = dueEntries.begin() + count(triggered.begin(), triggered.end(), true);
+    stable_sort(firstDue, dueEntries.end(), [](const Entry* a, const Entry* b) { return a->nextDue < b->nextDue; });
+
+    for(auto it = dueEntries.begin(); it != dueEntries.end(); ++it)
+    {
+        Entry&              entry = **it;
+        SampleTaskStats&    stats = entry.stats;
+
+        if(RemainingBudgetMs() <= 0)
+        {
+            ++stats.deferCnt;
+            continue;
+        }
+
+        auto start = steady_clock::now();
+        entry.task();
+        auto end = steady_clock::now();
+
+        stats.lastCostMs = duration<double, milli>(end - start).count();
+        stats.maxCostMs = max(stats.maxCostMs, stats.lastCostMs);
+        ++stats.runCnt;
+        // 提前触发且尚未到期的任务不推进节拍
+        if(entry.nextDue > m_cycleStart)
+        {
+            ++runNum;
+            continue;
+        }
+
+        stats.lastJitterMs = duration<double, milli>(start - entry.nextDue).count();
+        stats.maxJitterMs = max(stats.maxJitterMs, stats.lastJitterMs);
+        stats.totalJitterMs += stats.lastJitterMs;
+        ++stats.jitterCnt;
+
+        if(end - entry.nextDue > milliseconds(stats.deadlineMs))
+        {
+            ++stats.missCnt;
+            syslog(LOG_INFO, "[ERROR] SampleScheduler: %s missed deadline %d ms, cost %.1f ms.", stats.name.c_str(), stats.deadlineMs, stats.lastCostMs);
+        }
+
+        // 固定节拍推进；落后超过一个周期时从当前时间重新对齐，不补跑
+        entry.nextDue += milliseconds(stats.periodMs);
+        if(entry.nextDue <= end)
+        {
+            ++stats.overrunCnt;
+            entry.nextDue = end + milliseconds(stats.periodMs);
+        }
+        ++runNum;
+    }
+
+    if(RemainingBudgetMs() < 0)
+    {
+        ++m_budgetOverrunCnt;
+        syslog(LOG_INFO, "[ERROR] SampleScheduler: cycle took %d ms over budget %d ms.", -RemainingBudgetMs(), m_budgetMs);
+    }
+
+    return runNum;
+}
+
+int SampleScheduler::RemainingBudgetMs() const
+{
+    return m_budgetMs - (int)duration_cast<milliseconds>(steady_clock::now() - m_cycleStart).count();
+}
+
+vector<SampleTaskStats> SampleScheduler::GetStats() const
+{
+    vector<SampleTaskStats> stats;
+
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        stats.push_back(it->stats);
+    }
+
+    return stats;
+}
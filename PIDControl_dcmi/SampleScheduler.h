@@ -0,0 +1,123 @@
+#ifndef __SAMPLE_SCHEDULER_H__
+#define __SAMPLE_SCHEDULER_H__
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define SAMPLE_CPU_PERIOD_MS        1000    //sysfs 读取几乎没有开销，可配置到 100ms
+#define SAMPLE_SYS_PERIOD_MS        5000    //串口 !GTP 往返
+#define SAMPLE_CARD_PERIOD_MS       5000    //dcmi 查询
+#define SAMPLE_MIN_PERIOD_MS        50
+#define SAMPLE_CPU_DEADLINE_MS      100     //单次读取的等待上限，超时使用上一次的结果
+#define SAMPLE_SYS_DEADLINE_MS      100
+#define SAMPLE_CARD_DEADLINE_MS     500
+#define SAMPLE_CYCLE_BUDGET_MS      1000    //一轮到期任务的总耗时上限，超出的任务推迟到下一轮
+#define SAMPLE_CPU_MIN_MS           500     //自适应周期的上下限
+#define SAMPLE_CPU_MAX_MS           5000
+#define SAMPLE_SYS_MIN_MS           1000
+#define SAMPLE_SYS_MAX_MS           15000
+#define SAMPLE_CARD_MIN_MS          1000
+#define SAMPLE_CARD_MAX_MS          15000
+#define SAMPLE_SLOPE_HIGH           0.5     //°C/s，升降温快于该值时缩到最短周期
+#define SAMPLE_ERROR_HIGH           10      //°C，PID 偏差大于该值时缩到最短周期
+#define SAMPLE_STABLE_ROUNDS        3       //连续平稳的采样次数，之后每次把周期拉长 1.5 倍
+
+// 单个任务的自适应周期：温度变化快或偏差大时取 minMs，平稳时逐步拉长到 maxMs，其余情况回到 baseMs
+struct AdaptivePeriod
+{
+    bool    enable = true;
+    int     baseMs = 0;
+    int     minMs = 0;
+    int     maxMs = 0;
+    double  slopeHigh = SAMPLE_SLOPE_HIGH;
+    double  errorHigh = SAMPLE_ERROR_HIGH;
+};
+
+// 各采样任务的周期和截止时间，来自 /etc/FanControlParams.json 的 "sampling" 节点
+struct SampleConfig
+{
+    int cpuMs = SAMPLE_CPU_PERIOD_MS;
+    int sysMs = SAMPLE_SYS_PERIOD_MS;
+    int cardMs = SAMPLE_CARD_PERIOD_MS;
+    int cpuDeadlineMs = SAMPLE_CPU_DEADLINE_MS;
+    int sysDeadlineMs = SAMPLE_SYS_DEADLINE_MS;
+    int cardDeadlineMs = SAMPLE_CARD_DEADLINE_MS;
+    int budgetMs = SAMPLE_CYCLE_BUDGET_MS;
+    AdaptivePeriod cpuAdaptive = {true, SAMPLE_CPU_PERIOD_MS, SAMPLE_CPU_MIN_MS, SAMPLE_CPU_MAX_MS};
+    AdaptivePeriod sysAdaptive = {true, SAMPLE_SYS_PERIOD_MS, SAMPLE_SYS_MIN_MS, SAMPLE_SYS_MAX_MS};
+    AdaptivePeriod cardAdaptive = {true, SAMPLE_CARD_PERIOD_MS, SAMPLE_CARD_MIN_MS, SAMPLE_CARD_MAX_MS};
+};
+
+// 非法或缺失的字段沿用缺省值
+SampleConfig LoadSampleConfig(const char* path);
+
+struct SampleTaskStats
+{
+    std::string name;
+    int         periodMs = 0;
+    int         deadlineMs = 0;
+    long long   runCnt = 0;
+    long long   missCnt = 0;        //从到期到执行完超过 deadline 的次数
+    long long   deferCnt = 0;       //本轮预算用完而推迟的次数
+    long long   triggerCnt = 0;     //被事件提前唤醒执行的次数
+    long long   overrunCnt = 0;     //落后超过一个周期、跳过节拍重新对齐的次数
+    double      lastCostMs = 0;
+    double      maxCostMs = 0;
+    double      lastJitterMs = 0;   //实际开始执行时刻相对到期时刻的延后
+    double      maxJitterMs = 0;
+    double      totalJitterMs = 0;
+    long long   jitterCnt = 0;
+};
+
+// 多速率采样调度：每个任务有自己的周期和截止时间，RunOnce 睡到最早的到期时间后执行所有到期任务
+// 任务按固定节拍推进，执行慢了不会累积补跑；一轮的总耗时超过预算时，剩余任务推迟到下一轮优先执行
+// 等待使用 CLOCK_MONOTONIC 的 timerfd 绝对时刻，Trigger 通过 eventfd 唤醒，两者在同一个 poll 中等待
+class SampleScheduler
+{
+public:
+    typedef std::function<void()> Task;
+
+    SampleScheduler();
+    ~SampleScheduler();
+
+    // deadlineMs 为 0 时取周期，返回任务编号
+    int Add(const std::string& name, int periodMs, int deadlineMs, Task task);
+    // 所有任务下一次立即执行，用于从手动模式恢复
+    void Restart();
+    void SetBudget(int budgetMs) { m_budgetMs = budgetMs; }
+    // 在任务内部调用，从本次执行开始按新周期推进
+    void SetPeriod(int id, int periodMs);
+    // 可在其他线程调用：唤醒 RunOnce 并立即执行该任务，不改变它原有的节拍
+    void Trigger(int id);
+    // 返回本次执行的任务数
+    int RunOnce();
+    // 本轮剩余的预算，任务内部用它收紧自己的等待时间
+    int RemainingBudgetMs() const;
+    std::vector<SampleTaskStats> GetStats() const;
+    long long BudgetOverrunCount() const { return m_budgetOverrunCnt; }
+
+private:
+    // 睡到 due 或被 Trigger 唤醒
+    void WaitUntil(std::chrono::steady_clock::time_point due);
+
+    struct Entry
+    {
+        SampleTaskStats                         stats;
+        Task                                    task;
+        std::chrono::steady_clock::time_point   nextDue;
+    };
+
+    std::vector<Entry>                      m_entries;
+    int                                     m_budgetMs = SAMPLE_CYCLE_BUDGET_MS;
+    std::chrono::steady_clock::time_point   m_cycleStart;
+    long long                               m_budgetOverrunCnt = 0;
+    std::mutex                              m_wakeMutex;
+    std::vector<bool>                       m_triggered;
+    int                                     m_timerFd;
+    int                                     m_wakeFd;
+};
+
+#endif // __SAMPLE_SCHEDULER_H__
@@ -0,0 +1,120 @@
+#include "SensorWorker.h"
+#include <syslog.h>
+#include <algorithm>
+
+using namespace std;
+using namespace chrono;
+
+SensorWorker::SensorWorker(const string& name)
+    : m_name(name), m_request(false), m_busy(false), m_stop(false), m_reqSeq(0), m_doneSeq(0)
+{
+
+}
+
+SensorWorker::~SensorWorker()
+{
+    bool busy = false;
+
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+        busy = m_busy;
+    }
+    m_reqCv.notify_all();
+
+    if(!m_thread.joinable())
+    {
+        return;
+    }
+
+    // 卡在驱动调用里的线程无法等待，随进程退出
+    if(busy)
+    {
+        m_thread.detach();
+    }
+    else
+    {
+        m_thread.join();
+    }
+}
+
+void SensorWorker::Start(ReadFunc read)
+{
+    m_read = read;
+    m_thread = thread(&SensorWorker::Loop, this);
+}
+
+void SensorWorker::Loop()
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    while(true)
+    {
+        m_reqCv.wait(lock, [this] { return m_stop || m_request; });
+        if(m_stop)
+        {
+            return;
+        }
+
+        unsigned long long seq = m_reqSeq;
+        m_request = false;
+        m_busy = true;
+
+        lock.unlock();
+        int     value = 0;
+        auto    start = steady_clock::now();
+        int     ret = m_read(&value);
+        auto    end = steady_clock::now();
+        lock.lock();
+
+        m_last.value = value;
+        m_last.ret = ret;
+        m_last.time = end;
+        m_last.stale = false;
+        m_last.staleRounds = 0;
+        m_stats.lastCostMs = duration<double, milli>(end - start).count();
+        m_stats.maxCostMs = max(m_stats.maxCostMs, m_stats.lastCostMs);
+        m_busy = false;
+        m_doneSeq = seq;
+        m_doneCv.notify_all();
+    }
+}
+
+WorkerReading SensorWorker::Sample(int deadlineMs)
+{
+    unique_lock<mutex> lock(m_mutex);
+
+    ++m_stats.requestCnt;
+
+    // 上一次读取还卡着，不再排新请求
+    if(m_busy)
+    {
+        ++m_stats.overrunCnt;
+    }
+    else
+    {
+        ++m_reqSeq;
+        m_request = true;
+        m_reqCv.notify_one();
+    }
+
+    unsigned long long seq = m_reqSeq;
+    bool done = m_doneCv.wait_for(lock, milliseconds(max(deadlineMs, 0)), [this, seq] { return m_doneSeq >= seq; });
+    if(done)
+    {
+        return m_last;
+    }
+
+    ++m_stats.staleCnt;
+    ++m_last.staleRounds;
+    m_last.stale = true;
+    syslog(LOG_INFO, "[ERROR] SensorWorker %s: No sample within %d ms, use last one (stale %d).", m_name.c_str(), deadlineMs, m_last.staleRounds);
+    return m_last;
+}
+
+SensorWorkerStats SensorWorker::GetStats() const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    return m_stats;
+}
@@ -0,0 +1,71 @@
+#ifndef __SENSOR_WORKER_H__
+#define __SENSOR_WORKER_H__
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#define SENSOR_STALE_LIMIT  3       //连续这么多次拿到的都是旧数据，按读取失败处理
+
+// 一次读取结果，stale 表示本次请求没有在截止时间内完成，返回的是上一次的结果
+struct WorkerReading
+{
+    int                                     value = 0;
+    int                                     ret = -1;
+    std::chrono::steady_clock::time_point   time;
+    bool                                    stale = false;
+    int                                     staleRounds = 0;
+};
+
+struct SensorWorkerStats
+{
+    long long   requestCnt = 0;
+    long long   staleCnt = 0;       //截止时间内没有完成的请求
+    long long   overrunCnt = 0;     //上一次读取还没返回，本次请求没有下发
+    double      lastCostMs = 0;
+    double      maxCostMs = 0;
+};
+
+// 在独立线程中执行一个传感器的读取，调用方最多等待截止时间
+// 读取卡死时控制循环继续使用上一次的结果，不会跟着停住
+class SensorWorker
+{
+public:
+    typedef std::function<int(int*)> ReadFunc;
+
+    SensorWorker(const std::string& name);
+    ~SensorWorker();
+
+    SensorWorker(const SensorWorker&) = delete;
+    SensorWorker& operator=(const SensorWorker&) = delete;
+
+    void Start(ReadFunc read);
+    bool Started() const { return m_thread.joinable(); }
+    const std::string& Name() const { return m_name; }
+
+    // 请求一次读取并最多等待 deadlineMs
+    WorkerReading Sample(int deadlineMs);
+    SensorWorkerStats GetStats() const;
+
+private:
+    void Loop();
+
+    std::string                 m_name;
+    ReadFunc                    m_read;
+    std::thread                 m_thread;
+    mutable std::mutex          m_mutex;
+    std::condition_variable     m_reqCv;
+    std::condition_variable     m_doneCv;
+    bool                        m_request;
+    bool                        m_busy;
+    bool                        m_stop;
+    unsigned long long          m_reqSeq;
+    unsigned long long          m_doneSeq;
+    WorkerReading               m_last;
+    SensorWorkerStats           m_stats;
+};
+
+#endif // __SENSOR_WORKER_H__
@@ -0,0 +1,272 @@
+// 串口链路性能测试：统计单条命令往返时延 p50/p99/max、顺序与流水线两种模式下的命令吞吐和错误率
+// 用法：SerialBench [-n 命令数] [-b 流水线批大小] [-c set|temp|speed] [-p 设置的pwm] [-t 超时ms] [-s 波特率]
+// 默认连接 /dev/fanctrl，设置 FANCTRL_DEV 可改为模拟器；set 模式会真实改变 cpu 风扇转速，默认设为 100
+#include "SerialPort.h"
+#include "FanProtocol.h"
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <iostream>
+
+using namespace std;
+using namespace chrono;
+
+#define MAX_RECV_BUF_SIZE   1024
+#define MAX_PIPELINE_NUM    32
+
+struct BenchConfig
+{
+    int     cmdNum = 1000;
+    int     batchNum = 8;
+    string  cmdType = "set";
+    int     pwm = 100;
+    int     timeoutMs = 200;
+    int     baud = 0;       // 0 表示使用配置文件中的波特率
+};
+
+struct BenchResult
+{
+    vector<double>  latencyUs;
+    int             cmdCnt = 0;
+    int             errCnt = 0;
+    double          elapsedSec = 0;
+};
+
+static BenchConfig s_cfg;
+
+static int GetHelp()
+{
+    cout << "SerialBench [-n cmd_num] [-b batch_num] [-c set|temp|speed] [-p pwm] [-t timeout_ms] [-s baud]" << endl;
+    cout << "Device: " << SERIAL_DEV_PATH << ", override with " << SERIAL_DEV_ENV << "=<path>" << endl;
+    return 0;
+}
+
+static int ParseArgs(int argc, char* argv[])
+{
+    for(int i = 1; i < argc; ++i)
+    {
+        string opt = argv[i];
+        if(opt == "-h")
+        {
+            GetHelp();
+            exit(0);
+        }
+
+        if(i + 1 >= argc)
+        {
+            cout << "[ERROR] Missing value for " << opt << endl;
+            return -1;
+        }
+
+        const char* value = argv[++i];
+        if(opt == "-n")         s_cfg.cmdNum = atoi(value);
+        else if(opt == "-b")    s_cfg.batchNum = atoi(value);
+        else if(opt == "-c")    s_cfg.cmdType = value;
+        else if(opt == "-p")    s_cfg.pwm = atoi(value);
+        else if(opt == "-t")    s_cfg.timeoutMs = atoi(value);
+        else if(opt == "-s")    s_cfg.baud = atoi(value);
+        else
+        {
+            cout << "[ERROR] Unknown option " << opt << endl;
+            return -1;
+        }
+    }
+
+    if(s_cfg.cmdNum <= 0 || s_cfg.batchNum <= 0 || s_cfg.batchNum > MAX_PIPELINE_NUM)
+    {
+        cout << "[ERROR] cmd_num must be > 0 and batch_num must be 1~" << MAX_PIPELINE_NUM << endl;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int EncodeBenchCmd(char* cmd)
+{
+    if(s_cfg.cmdType == "set")
+    {
+        return EncodeSetPwm(cmd, FAN_CMD_BUF_SIZE, 0, s_cfg.pwm);
+    }
+    else if(s_cfg.cmdType == "temp")
+    {
+        return EncodeQuery(cmd, FAN_CMD_BUF_SIZE, FAN_QUERY_TEMP);
+    }
+    else if(s_cfg.cmdType == "speed")
+    {
+        return EncodeQuery(cmd, FAN_CMD_BUF_SIZE, FAN_QUERY_SPEED);
+    }
+
+    return -1;
+}
+
+// 应答必须以命令回显开头，查询命令还要能解析出数值
+static bool CheckReply(const char* cmd, int cmdLen, const char* reply, int replyLen)
+{
+    if(replyLen < cmdLen || memcmp(cmd, reply, cmdLen) != 0)
+    {
+        return false;
+    }
+
+    if(s_cfg.cmdType == "temp")
+    {
+        FanTempReply tempReply;
+        return ParseTempReply(reply, replyLen, &tempReply) == FAN_REPLY_OK;
+    }
+    else if(s_cfg.cmdType == "speed")
+    {
+        FanSpeedReply speedReply;
+        return ParseSpeedReply(reply, replyLen, &speedReply) == FAN_REPLY_OK;
+    }
+
+    return true;
+}
+
+static BenchResult RunSequential(int fd, const char* cmd, int cmdLen)
+{
+    BenchResult result;
+    char        recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    auto        start = steady_clock::now();
+
+    for(int i = 0; i < s_cfg.cmdNum; ++i)
+    {
+        auto t0 = steady_clock::now();
+        int ret = SerialWrite(fd, cmd, cmdLen);
+        if(ret == 0)
+        {
+            ret = SerialReadFrame(fd, recvBuf, MAX_RECV_BUF_SIZE, s_cfg.timeoutMs);
+        }
+        result.latencyUs.push_back(duration<double, micro>(steady_clock::now() - t0).count());
+
+        ++result.cmdCnt;
+        if(ret < 0 || !CheckReply(cmd, cmdLen, recvBuf, ret))
+        {
+            ++result.errCnt;
+        }
+    }
+
+    result.elapsedSec = duration<double>(steady_clock::now() - start).count();
+    return result;
+}
+
+// 每批 batchNum 条命令一次 writev，记录整批往返时延
+static BenchResult RunPipelined(int fd, const char* cmd, int cmdLen)
+{
+    BenchResult     result;
+    char            recvBuf[MAX_RECV_BUF_SIZE] = {0};
+    struct iovec    iov[MAX_PIPELINE_NUM];
+    auto            start = steady_clock::now();
+
+    for(int sent = 0; sent < s_cfg.cmdNum; sent += s_cfg.batchNum)
+    {
+        int batchNum = min(s_cfg.batchNum, s_cfg.cmdNum - sent);
+        for(int i = 0; i < batchNum; ++i)
+        {
+            iov[i].iov_base = (void*)cmd;
+            iov[i].iov_len = cmdLen;
+        }
+
+        auto t0 = steady_clock::now();
+        int ret = SerialWriteV(fd, iov, batchNum);
+        if(ret == 0)
+        {
+            ret = SerialReadFrames(fd, recvBuf, MAX_RECV_BUF_SIZE, batchNum, s_cfg.timeoutMs * batchNum);
+        }
+        result.latencyUs.push_back(duration<double, micro>(steady_clock::now() - t0).count());
+
+        // 按 '\n' 切分应答逐条校验
+        int okCnt = 0;
+        char* frame = recvBuf;
+        while(ret > 0 && okCnt < batchNum)
+        {
+            char* end = strchr(frame, '\n');
+            if(end == NULL || !CheckReply(cmd, cmdLen, frame, end - frame + 1))
+            {
+                break;
+            }
+
+            ++okCnt;
+            frame = end + 1;
+        }
+
+        result.cmdCnt += batchNum;
+        result.errCnt += batchNum - okCnt;
+    }
+
+    result.elapsedSec = duration<double>(steady_clock::now() - start).count();
+    return result;
+}
+
+static double Percentile(vector<double> values, double p)
+{
+    if(values.empty())
+    {
+        return 0;
+    }
+
+    sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+static void PrintResult(const string& name, const BenchResult& result, int cmdPerSample)
+{
+    double maxUs = result.latencyUs.empty() ? 0 : *max_element(result.latencyUs.begin(), result.latencyUs.end());
+
+    cout << name << ":" << endl;
+    cout << "  latency per " << (cmdPerSample > 1 ? "batch of " + to_string(cmdPerSample) : string("command"))
+         << " (us): p50 " << Percentile(result.latencyUs, 0.5) << ", p99 " << Percentile(result.latencyUs, 0.99)
+         << ", max " << maxUs << endl;
+    cout << "  throughput: " << (result.elapsedSec > 0 ? result.cmdCnt / result.elapsedSec : 0) << " cmd/s" << endl;
+    cout << "  errors: " << result.errCnt << "/" << result.cmdCnt << " ("
+         << (result.cmdCnt > 0 ? 100.0 * result.errCnt / result.cmdCnt : 0) << "%)" << endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int     fd = 0;
+    int     ret = -1;
+    char    cmd[FAN_CMD_BUF_SIZE] = {0};
+    int     cmdLen = 0;
+
+    if(ParseArgs(argc, argv) != 0)
+    {
+        GetHelp();
+        return -1;
+    }
+
+    cmdLen = EncodeBenchCmd(cmd);
+    if(cmdLen <= 0)
+    {
+        cout << "[ERROR] Invalid command type or pwm, supported type: set, temp, speed; pwm: 0~100." << endl;
+        return -1;
+    }
+
+    SerialLoadConfig("/etc/FanControlParams.json");
+    ret = SerialOpen(&fd);
+    if(ret != 0)
+    {
+        cout << "[ERROR] Fail to open serial port " << SerialDevPath() << "!" << endl;
+        return -1;
+    }
+
+    if(s_cfg.baud > 0 && SerialSetBaud(fd, s_cfg.baud) != 0)
+    {
+        cout << "[ERROR] Baud " << s_cfg.baud << " is not supported by " << SerialDevPath() << endl;
+        SerialClose(&fd);
+        return -1;
+    }
+
+    cout << "Device: " << SerialDevPath() << ", baud: " << (s_cfg.baud > 0 ? s_cfg.baud : SerialGetConfig().baud)
+         << ", command: " << cmd << ", count: " << s_cfg.cmdNum
+         << ", batch: " << s_cfg.batchNum << endl;
+
+    PrintResult("sequential", RunSequential(fd, cmd, cmdLen), 1);
+    PrintResult("pipelined", RunPipelined(fd, cmd, cmdLen), s_cfg.batchNum);
+
+    SerialClose(&fd);
+    return 0;
+}
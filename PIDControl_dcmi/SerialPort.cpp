@@ -2,22 +2,60 @@
 #include <syslog.h>
 #include <termios.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/uio.h>
 #include "SerialPort.h"
+#include "json.hpp"
+#include <fstream>
 
-#define SERIAL_OPEN_ERROR           0xE0000001
-#define SERIAL_INIT_ERROR           0xE0000002
+using namespace std;
+using json = nlohmann::json;
+
+#define SERIAL_FRAME_GAP_MS         5       //收到数据后总线空闲超过该时间视为一帧结束
+
+static long long MonotonicMs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static SerialLinkConfig s_config;
+
+static const int s_speedArr[] = { B921600, B460800, B230400, B115200, B57600, B38400, B19200, B9600, B4800, B2400, B1200, B300};
+static const int s_nameArr[] = {921600, 460800, 230400, 115200, 57600, 38400, 19200, 9600, 4800, 2400, 1200, 300};
+
+static int BaudToSpeed(int baud)
+{
+    for(size_t i = 0; i < sizeof(s_nameArr) / sizeof(int); ++i)
+    {
+        if(baud == s_nameArr[i])
+        {
+            return s_speedArr[i];
+        }
+    }
+
+    return -1;
+}
 
 int UART0_Set(int fd,int speed,int flow_ctrl,int databits,int stopbits,int parity)    
 {    
        
-    int   i;    
-    int   status;    
-    int   speed_arr[] = { B115200, B19200, B9600, B4800, B2400, B1200, B300};    
-    int   name_arr[] = {115200,  19200,  9600,  4800,  2400,  1200,  300};    
+    int   speedVal = BaudToSpeed(speed);
              
     struct termios options;    
+
+    if(speedVal < 0)
+    {
+        syslog(LOG_INFO, "UART0_Set: Unsupported baud rate %d", speed);
+        return SERIAL_INIT_ERROR;
+    }
+
        
     /*  tcgetattr(fd,&options)得到与fd指向对象的相关参数，并将它们保存于options,该函数还可以测试配置是否正确，
         该串口是否可用等。若调用成功，函数返回值为0，若调用失败，函数返回值为1.  */    
@@ -29,14 +67,8 @@ int UART0_Set(int fd,int speed,int flow_ctrl,int databits,int stopbits,int parit
     }    
       
     //设置串口输入波特率和输出波特率    
-    for ( i= 0;  i < sizeof(speed_arr) / sizeof(int);  i++)    
-    {    
-        if  (speed == name_arr[i])    
-        {                 
-            cfsetispeed(&options, speed_arr[i]);     
-            cfsetospeed(&options, speed_arr[i]);      
-        }    
-    }         
+    cfsetispeed(&options, speedVal);     
+    cfsetospeed(&options, speedVal);      
        
     //修改控制模式，保证程序不会占用串口    
     options.c_cflag |= CLOCAL;    
@@ -48,15 +80,21 @@ int UART0_Set(int fd,int speed,int flow_ctrl,int databits,int stopbits,int parit
     {    
           
         case 0 ://不使用流控制    
-              options.c_cflag &= CRTSCTS;    
+              options.c_cflag &= ~CRTSCTS;    
+              options.c_iflag &= ~(IXON | IXOFF | IXANY);    
               break;       
           
         case 1 ://使用硬件流控制    
               options.c_cflag |= CRTSCTS;    
+              options.c_iflag &= ~(IXON | IXOFF | IXANY);    
               break;    
-        case 2 ://使用软件流控制    
-              options.c_cflag |= IXON | IXOFF | IXANY;    
+        case 2 ://使用软件流控制，IXON 等属于输入模式标志    
+              options.c_cflag &= ~CRTSCTS;    
+              options.c_iflag |= IXON | IXOFF | IXANY;    
               break;    
+        default:
+              fprintf(stderr,"Unsupported flow control\n");    
+              return SERIAL_INIT_ERROR;
     }    
     //设置数据位    
     //屏蔽其他标志位    
@@ -146,9 +184,8 @@ int UART0_Set(int fd,int speed,int flow_ctrl,int databits,int stopbits,int parit
 
 int UART0_Init(int fd, int speed,int flow_ctrl,int databits,int stopbits,int parity)    
 {    
-    int err;    
     //设置串口数据帧格式    
-    if (UART0_Set(fd,115200,2,8,1,'N') == SERIAL_INIT_ERROR)    
+    if (UART0_Set(fd,speed,flow_ctrl,databits,stopbits,parity) == SERIAL_INIT_ERROR)    
     {                                                             
         return SERIAL_INIT_ERROR;    
     }    
@@ -158,19 +195,121 @@ int UART0_Init(int fd, int speed,int flow_ctrl,int databits,int stopbits,int par
     }    
 }    
 
+int SerialLoadConfig(const char* path)
+{
+    SerialLinkConfig    config;
+    json                root;
+    ifstream            file(path);
+
+    if(!file.is_open())
+    {
+        return 0;
+    }
+
+    root = json::parse(file, nullptr, false);
+    if(root.is_discarded() || !root.is_object() || !root.contains("serial"))
+    {
+        return 0;
+    }
+
+    const json& node = root["serial"];
+    if(!node.is_object())
+    {
+        syslog(LOG_INFO, "[ERROR] SerialLoadConfig: serial is not object type, use default link config.");
+        return SERIAL_INIT_ERROR;
+    }
+
+    if(node.contains("baud") && node["baud"].is_number_integer())           config.baud = node["baud"];
+    if(node.contains("flow_ctrl") && node["flow_ctrl"].is_number_integer()) config.flowCtrl = node["flow_ctrl"];
+    if(node.contains("data_bits") && node["data_bits"].is_number_integer()) config.dataBits = node["data_bits"];
+    if(node.contains("stop_bits") && node["stop_bits"].is_number_integer()) config.stopBits = node["stop_bits"];
+    if(node.contains("probe") && node["probe"].is_boolean())                config.probe = node["probe"];
+    if(node.contains("parity") && node["parity"].is_string() && node["parity"].get<string>().size() == 1)
+    {
+        config.parity = node["parity"].get<string>()[0];
+    }
+    if(node.contains("ack"))
+    {
+        if(!node["ack"].is_string() || (node["ack"] != "echo" && node["ack"] != "none"))
+        {
+            syslog(LOG_INFO, "[ERROR] SerialLoadConfig: ack must be \"echo\" or \"none\", use default link config.");
+            return SERIAL_INIT_ERROR;
+        }
+        config.ackEcho = node["ack"] == "echo";
+    }
+
+    if(BaudToSpeed(config.baud) < 0 || config.flowCtrl < 0 || config.flowCtrl > 2 || config.dataBits < 5 || config.dataBits > 8
+        || (config.stopBits != 1 && config.stopBits != 2) || strchr("NnOoEeSs", config.parity) == NULL)
+    {
+        syslog(LOG_INFO, "[ERROR] SerialLoadConfig: Invalid serial config, use default link config.");
+        return SERIAL_INIT_ERROR;
+    }
+
+    s_config = config;
+    syslog(LOG_INFO, "[INFO] SerialLoadConfig: baud %d, flow_ctrl %d, %d%c%d, probe %d, ack %s.", config.baud, config.flowCtrl,
+        config.dataBits, config.parity, config.stopBits, config.probe, config.ackEcho ? "echo" : "none");
+    return 0;
+}
+
+void SerialSetConfig(const SerialLinkConfig& config)
+{
+    s_config = config;
+}
+
+const SerialLinkConfig& SerialGetConfig()
+{
+    return s_config;
+}
+
+int SerialSetBaud(int fd, int baud)
+{
+    int             speedVal = BaudToSpeed(baud);
+    struct termios  options;
+
+    if(speedVal < 0 || tcgetattr(fd, &options) != 0)
+    {
+        return SERIAL_INIT_ERROR;
+    }
+
+    cfsetispeed(&options, speedVal);
+    cfsetospeed(&options, speedVal);
+    if(tcsetattr(fd, TCSADRAIN, &options) != 0)
+    {
+        return SERIAL_INIT_ERROR;
+    }
+
+    // 部分 USB 串口适配器不报错但不生效，回读确认
+    if(tcgetattr(fd, &options) != 0 || cfgetospeed(&options) != (speed_t)speedVal)
+    {
+        return SERIAL_INIT_ERROR;
+    }
+
+    tcflush(fd, TCIOFLUSH);
+    return 0;
+}
+
+const char* SerialDevPath()
+{
+    const char* path = getenv(SERIAL_DEV_ENV);
+
+    return (path != NULL && path[0] != '\0') ? path : SERIAL_DEV_PATH;
+}
+
 int SerialOpen(int* pFd)
 {
-    *pFd = open("/dev/fanctrl", O_RDWR | O_NOCTTY | O_NDELAY);
+    *pFd = open(SerialDevPath(), O_RDWR | O_NOCTTY | O_NDELAY);
     // *pFd = open("/dev/ttyUSB0", O_RDWR | O_NOCTTY | O_NDELAY);
     if(*pFd < 0)
     {
-        syslog(LOG_INFO, "SerialPort: Open /dev/fanctrl failed!");
+        syslog(LOG_INFO, "SerialPort: Open %s failed!", SerialDevPath());
         return SERIAL_OPEN_ERROR;
     }
 
-    if(UART0_Init(*pFd,115200,0,8,1,'N') != 0 )
+    if(UART0_Init(*pFd, s_config.baud, s_config.flowCtrl, s_config.dataBits, s_config.stopBits, s_config.parity) != 0 )
     {
         syslog(LOG_INFO, "SerialPort: UART0_Init failed!");
+        close(*pFd);
+        *pFd = 0;
         return SERIAL_OPEN_ERROR;
     }
 
@@ -180,9 +319,156 @@ int SerialOpen(int* pFd)
 
 void SerialClose(int* pFd)
 {
-    if(pFd != NULL && *pFd == 0)
+    if(pFd != NULL && *pFd > 0)
     {
         close(*pFd);
         *pFd = 0;
     }
 }
+
+
+int SerialWriteV(int fd, struct iovec* iov, int iovCnt)
+{
+    // 上一条命令超时后迟到的应答不能算到这一条上
+    tcflush(fd, TCIFLUSH);
+
+    while(iovCnt > 0)
+    {
+        int ret = writev(fd, iov, iovCnt);
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            if(errno == EAGAIN)
+            {
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                poll(&pfd, 1, SERIAL_FRAME_GAP_MS);
+                continue;
+            }
+
+            syslog(LOG_INFO, "SerialPort: writev failed, errno %d", errno);
+            return SERIAL_WRITE_ERROR;
+        }
+
+        // 部分写入时跳过已发送的部分
+        while(iovCnt > 0 && ret >= (int)iov->iov_len)
+        {
+            ret -= iov->iov_len;
+            ++iov;
+            --iovCnt;
+        }
+
+        if(iovCnt > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return 0;
+}
+
+int SerialWrite(int fd, const char* cmd, int cmdLen)
+{
+    struct iovec iov = {(void*)cmd, (size_t)cmdLen};
+
+    return SerialWriteV(fd, &iov, 1);
+}
+
+int SerialReadFrames(int fd, char* recvBuf, int recvBufLen, int frameCnt, int timeoutMs)
+{
+    int         total = 0;
+    int         frames = 0;
+    long long   deadline = MonotonicMs() + timeoutMs;
+
+    memset(recvBuf, 0, recvBufLen);
+
+    while(total < recvBufLen - 1 && frames < frameCnt)
+    {
+        long long left = deadline - MonotonicMs();
+        if(left <= 0)
+        {
+            break;
+        }
+
+        // 单帧时允许以总线空闲判定帧尾；多帧时必须等齐 '\n'
+        int wait = (int)left;
+        if(frameCnt == 1 && total > 0 && wait > SERIAL_FRAME_GAP_MS)
+        {
+            wait = SERIAL_FRAME_GAP_MS;
+        }
+
+        struct pollfd pfd = {fd, POLLIN, 0};
+        int ret = poll(&pfd, 1, wait);
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            syslog(LOG_INFO, "SerialPort: poll failed, errno %d", errno);
+            return SERIAL_READ_ERROR;
+        }
+
+        if(ret == 0)
+        {
+            if(frameCnt == 1 && total > 0)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        if(!(pfd.revents & POLLIN))
+        {
+            // POLLERR / POLLHUP：设备被拔出或出错
+            syslog(LOG_INFO, "SerialPort: poll revents 0x%x", pfd.revents);
+            return SERIAL_READ_ERROR;
+        }
+
+        int n = read(fd, recvBuf + total, recvBufLen - 1 - total);
+        if(n < 0)
+        {
+            if(errno == EINTR || errno == EAGAIN)
+            {
+                continue;
+            }
+
+            syslog(LOG_INFO, "SerialPort: read failed, errno %d", errno);
+            return SERIAL_READ_ERROR;
+        }
+
+        // 可读但读到 0 字节：对端已挂断（USB 串口被拔出、模拟器退出），交给会话重连
+        if(n == 0)
+        {
+            syslog(LOG_INFO, "SerialPort: read returned EOF, peer hung up");
+            return SERIAL_READ_ERROR;
+        }
+
+        for(int i = total; i < total + n; ++i)
+        {
+            if(recvBuf[i] == '\n')
+            {
+                ++frames;
+            }
+        }
+        total += n;
+    }
+
+    if(total == 0)
+    {
+        return SERIAL_TIMEOUT_ERROR;
+    }
+
+    return total;
+}
+
+int SerialReadFrame(int fd, char* recvBuf, int recvBufLen, int timeoutMs)
+{
+    return SerialReadFrames(fd, recvBuf, recvBufLen, 1, timeoutMs);
+}
@@ -1,7 +1,48 @@
 #ifndef SERIAL_PORT_H
 #define SERIAL_PORT_H
 
+#include <sys/uio.h>
+
+#define SERIAL_OPEN_ERROR           0xE0000001
+#define SERIAL_INIT_ERROR           0xE0000002
+#define SERIAL_WRITE_ERROR          0xE0000003
+#define SERIAL_READ_ERROR           0xE0000004
+#define SERIAL_TIMEOUT_ERROR        0xE0000005
+
+#define SERIAL_DEV_PATH             "/dev/fanctrl"
+#define SERIAL_DEV_ENV              "FANCTRL_DEV"   //设置后改为打开该设备，用于连接模拟器
+
+// 链路参数，来自 /etc/FanControlParams.json 的 "serial" 节点，缺省为 115200 8N1 无流控
+struct SerialLinkConfig
+{
+    int     baud = 115200;
+    int     flowCtrl = 0;       // 0 无流控，1 硬件流控，2 软件流控
+    int     dataBits = 8;
+    int     stopBits = 1;
+    char    parity = 'N';
+    bool    probe = false;      // 打开串口后尝试更高的波特率
+    bool    ackEcho = false;    // "ack": "echo" 时按 $F<ch>S<pwm> 回显确认设置，缺省 "none" 写入成功即视为生效
+};
+
+// 读取配置文件中的 "serial" 节点，节点不存在时使用缺省值，参数非法返回 SERIAL_INIT_ERROR
+int SerialLoadConfig(const char* path);
+void SerialSetConfig(const SerialLinkConfig& config);
+const SerialLinkConfig& SerialGetConfig();
+// 只修改波特率，适配器不支持该速率时返回 SERIAL_INIT_ERROR
+int SerialSetBaud(int fd, int baud);
+
+const char* SerialDevPath();
 int SerialOpen(int* pFd);
 void SerialClose(int* pFd);
 
-#endif // SERIAL_PORT_H
\ No newline at end of file
+// 丢弃残留的应答后写入整条命令，返回 0 或 SERIAL_WRITE_ERROR
+int SerialWrite(int fd, const char* cmd, int cmdLen);
+// 一次 writev 写入多条命令，iov 会被修改
+int SerialWriteV(int fd, struct iovec* iov, int iovCnt);
+// 读取一帧应答：收到 '\n' 或总线空闲超过帧间隔即返回，timeoutMs 为整帧的截止时间
+// 成功返回读到的字节数，失败返回 SERIAL_READ_ERROR / SERIAL_TIMEOUT_ERROR
+int SerialReadFrame(int fd, char* recvBuf, int recvBufLen, int timeoutMs);
+// 读取 frameCnt 个以 '\n' 结尾的应答帧（流水线发送后使用），截止时间到仍未收齐则返回已收到的部分
+int SerialReadFrames(int fd, char* recvBuf, int recvBufLen, int frameCnt, int timeoutMs);
+
+#endif // SERIAL_PORT_H
@@ -0,0 +1,180 @@
+#include "SerialSession.h"
+#include "SerialPort.h"
+#include "FanProtocol.h"
+#include <unistd.h>
+#include <syslog.h>
+#include <algorithm>
+
+using namespace std;
+using namespace chrono;
+
+SerialSession::SerialSession()
+    : m_fd(0), m_state(SESSION_CLOSED), m_backoffMs(SESSION_BACKOFF_MIN_MS), m_nextRetryMs(0),
+      m_downSinceMs(0), m_timeoutCnt(0), m_reconnectCnt(0), m_reconnectMs(0),
+      m_linkBaud(0)
+{
+}
+
+SerialSession::~SerialSession()
+{
+    Close();
+}
+
+long long SerialSession::NowMs() const
+{
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void SerialSession::Close()
+{
+    SerialClose(&m_fd);
+    m_fd = 0;
+}
+
+int SerialSession::Open()
+{
+    int ret = SerialOpen(&m_fd);
+    if(ret != 0)
+    {
+        Close();
+        return ret;
+    }
+
+    m_state = SESSION_OPEN;
+    m_timeoutCnt = 0;
+    m_linkBaud = SerialGetConfig().baud;
+
+    // 重连后风扇板可能已复位，每次打开都重新探测
+    if(SerialGetConfig().probe)
+    {
+        ProbeBaud();
+    }
+    return 0;
+}
+
+bool SerialSession::EchoTest(int rounds)
+{
+    char            cmd[FAN_CMD_BUF_SIZE] = {0};
+    char            recvBuf[64] = {0};
+    int             cmdLen = EncodeQuery(cmd, FAN_CMD_BUF_SIZE, FAN_QUERY_TEMP);
+    FanTempReply    reply;
+
+    for(int i = 0; i < rounds; ++i)
+    {
+        int ret = SerialWrite(m_fd, cmd, cmdLen);
+        if(ret == 0)
+        {
+            ret = SerialReadFrame(m_fd, recvBuf, sizeof(recvBuf), SESSION_PROBE_TIMEOUT_MS);
+        }
+
+        if(ret < 0 || ParseTempReply(recvBuf, ret, &reply) != FAN_REPLY_OK)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SerialSession::ProbeBaud()
+{
+    static const int probeBauds[] = {921600, 460800, 230400};
+    int baseBaud = SerialGetConfig().baud;
+
+    for(int baud : probeBauds)
+    {
+        if(baud <= baseBaud)
+        {
+            continue;
+        }
+
+        // 适配器不支持该速率
+        if(SerialSetBaud(m_fd, baud) != 0)
+        {
+            continue;
+        }
+
+        if(EchoTest(SESSION_PROBE_ROUNDS))
+        {
+            m_linkBaud = baud;
+            syslog(LOG_INFO, "[INFO] SerialSession: Probe baud %d passed %d echo tests, use it.", baud, SESSION_PROBE_ROUNDS);
+            return;
+        }
+
+        syslog(LOG_INFO, "[INFO] SerialSession: Probe baud %d failed.", baud);
+    }
+
+    // 没有更快的可用速率，回到配置值
+    if(SerialSetBaud(m_fd, baseBaud) != 0)
+    {
+        syslog(LOG_INFO, "[ERROR] SerialSession: Fail to restore baud %d.", baseBaud);
+    }
+    m_linkBaud = baseBaud;
+}
+
+int SerialSession::Fd()
+{
+    if(m_state == SESSION_OPEN)
+    {
+        return m_fd;
+    }
+
+    long long now = NowMs();
+    if(m_state == SESSION_BACKOFF && now < m_nextRetryMs)
+    {
+        return 0;
+    }
+
+    if(Open() != 0)
+    {
+        m_state = SESSION_BACKOFF;
+        m_nextRetryMs = now + m_backoffMs;
+        syslog(LOG_INFO, "[ERROR] SerialSession: Reopen %s failed, retry in %d ms.", SerialDevPath(), m_backoffMs);
+        m_backoffMs = min(m_backoffMs * 2, SESSION_BACKOFF_MAX_MS);
+        return 0;
+    }
+
+    if(m_downSinceMs != 0)
+    {
+        ++m_reconnectCnt;
+        m_reconnectMs += NowMs() - m_downSinceMs;
+        m_downSinceMs = 0;
+        syslog(LOG_INFO, "[INFO] SerialSession: %s reconnected, reconnect count %d, total reconnect time %lld ms.", SerialDevPath(),
+            m_reconnectCnt, m_reconnectMs);
+    }
+
+    m_backoffMs = SESSION_BACKOFF_MIN_MS;
+    return m_fd;
+}
+
+void SerialSession::Report(int ret)
+{
+    if(ret >= 0)
+    {
+        m_timeoutCnt = 0;
+        return;
+    }
+
+    if((unsigned int)ret == SERIAL_TIMEOUT_ERROR)
+    {
+        if(++m_timeoutCnt < SESSION_MAX_TIMEOUTS)
+        {
+            return;
+        }
+    }
+    else if((unsigned int)ret != SERIAL_READ_ERROR && (unsigned int)ret != SERIAL_WRITE_ERROR)
+    {
+        return;
+    }
+
+    if(m_state != SESSION_OPEN)
+    {
+        return;
+    }
+
+    syslog(LOG_INFO, "[ERROR] SerialSession: Link to %s lost (ret 0x%x), reconnecting.", SerialDevPath(), (unsigned int)ret);
+    Close();
+    m_state = SESSION_BACKOFF;
+    m_nextRetryMs = NowMs() + m_backoffMs;
+    m_downSinceMs = NowMs();
+}
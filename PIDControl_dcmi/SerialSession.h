@@ -0,0 +1,55 @@
+#ifndef __SERIAL_SESSION_H__
+#define __SERIAL_SESSION_H__
+
+#include <chrono>
+
+#define SESSION_BACKOFF_MIN_MS      500
+#define SESSION_BACKOFF_MAX_MS      30000
+#define SESSION_MAX_TIMEOUTS        3       //连续无应答次数达到该值视为链路断开
+#define SESSION_PROBE_ROUNDS        20      //每个候选波特率连续 !GTP 回显成功的次数
+#define SESSION_PROBE_TIMEOUT_MS    50
+
+// 长期持有 /dev/fanctrl 的 fd，只在出错或热插拔后重新打开，重连间隔按指数退避
+class SerialSession
+{
+public:
+    SerialSession();
+    ~SerialSession();
+
+    int Open();
+    // 返回可用的 fd；处于断开状态时按退避时间尝试重连，仍不可用返回 0
+    int Fd();
+    // 每次收发后上报结果，读写错误或连续超时会关闭 fd 进入重连状态
+    void Report(int ret);
+    bool IsOpen() const { return m_state == SESSION_OPEN; }
+
+    int ReconnectCount() const { return m_reconnectCnt; }
+    long long ReconnectMs() const { return m_reconnectMs; }
+    int LinkBaud() const { return m_linkBaud; }
+
+private:
+    enum State
+    {
+        SESSION_CLOSED,
+        SESSION_OPEN,
+        SESSION_BACKOFF,
+    };
+
+    void Close();
+    long long NowMs() const;
+    // 从高到低尝试比配置更快的波特率，保留第一个回显全部正确的
+    void ProbeBaud();
+    bool EchoTest(int rounds);
+
+    int                                                 m_fd;
+    State                                               m_state;
+    int                                                 m_backoffMs;
+    long long                                           m_nextRetryMs;
+    long long                                           m_downSinceMs;
+    int                                                 m_timeoutCnt;
+    int                                                 m_reconnectCnt;
+    long long                                           m_reconnectMs;
+    int                                                 m_linkBaud;
+};
+
+#endif // __SERIAL_SESSION_H__
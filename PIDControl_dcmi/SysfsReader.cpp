@@ -0,0 +1,145 @@
+#include "SysfsReader.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+using namespace std;
+
+int ParseSysfsInt(const char* buf, int len, long long* pValue)
+{
+    int         i = 0;
+    bool        neg = false;
+    long long   value = 0;
+
+    while(i < len && (buf[i] == ' ' || buf[i] == '\t'))
+    {
+        ++i;
+    }
+
+    if(i < len && (buf[i] == '-' || buf[i] == '+'))
+    {
+        neg = buf[i] == '-';
+        ++i;
+    }
+
+    int start = i;
+    while(i < len && buf[i] >= '0' && buf[i] <= '9')
+    {
+        value = value * 10 + (buf[i] - '0');
+        ++i;
+    }
+
+    // 至少一位数字，之后只能是换行或结束
+    if(i == start || (i < len && buf[i] != '\n' && buf[i] != '\0'))
+    {
+        return -1;
+    }
+
+    *pValue = neg ? -value : value;
+    return 0;
+}
+
+int ReadSysfsInt(const char* path, long long* pValue)
+{
+    SysfsReader reader(path);
+
+    return reader.Read(pValue);
+}
+
+
+// SysfsReader 成员函数
+SysfsReader::SysfsReader()
+    : m_fd(-1), m_reopenCnt(0), m_errorCnt(0)
+{
+
+}
+
+SysfsReader::SysfsReader(const string& path)
+    : m_path(path), m_fd(-1), m_reopenCnt(0), m_errorCnt(0)
+{
+
+}
+
+SysfsReader::~SysfsReader()
+{
+    Close();
+}
+
+void SysfsReader::SetPath(const string& path)
+{
+    Close();
+    m_path = path;
+}
+
+int SysfsReader::Open()
+{
+    if(m_fd >= 0)
+    {
+        return 0;
+    }
+
+    if(m_path.empty())
+    {
+        return -1;
+    }
+
+    m_fd = open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    return m_fd >= 0 ? 0 : -1;
+}
+
+void SysfsReader::Close()
+{
+    if(m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+int SysfsReader::ReadOnce(long long* pValue)
+{
+    char    buf[SYSFS_READ_BUF_SIZE];
+    ssize_t len = 0;
+
+    if(Open() != 0)
+    {
+        return -1;
+    }
+
+    // sysfs 属性每次从偏移 0 读取都会重新取值
+    do
+    {
+        len = pread(m_fd, buf, sizeof(buf), 0);
+    } while(len < 0 && errno == EINTR);
+
+    if(len <= 0)
+    {
+        return -1;
+    }
+
+    return ParseSysfsInt(buf, (int)len, pValue);
+}
+
+int SysfsReader::Read(long long* pValue)
+{
+    if(ReadOnce(pValue) == 0)
+    {
+        return 0;
+    }
+
+    // 驱动重载或热插拔后旧 fd 失效，重开再试一次
+    bool wasOpen = m_fd >= 0;
+    Close();
+    if(wasOpen)
+    {
+        ++m_reopenCnt;
+        if(ReadOnce(pValue) == 0)
+        {
+            return 0;
+        }
+        Close();
+    }
+
+    ++m_errorCnt;
+    return -1;
+}
@@ -0,0 +1,49 @@
+#ifndef __SYSFS_READER_H__
+#define __SYSFS_READER_H__
+
+#include <string>
+
+#define SYSFS_READ_BUF_SIZE 32
+#define THERMAL_ROOT_PATH   "/sys/class/thermal"
+#define HWMON_ROOT_PATH     "/sys/class/hwmon"
+
+// 长期持有 sysfs 属性文件的 fd，每次从偏移 0 处 pread 并直接解析整数
+// 只在读失败时关闭并重新打开一次，采样周期内不再构造文件流
+class SysfsReader
+{
+public:
+    SysfsReader();
+    explicit SysfsReader(const std::string& path);
+    ~SysfsReader();
+
+    SysfsReader(const SysfsReader&) = delete;
+    SysfsReader& operator=(const SysfsReader&) = delete;
+
+    // 更换文件路径，原 fd 关闭，下次 Read 时打开
+    void SetPath(const std::string& path);
+    const std::string& Path() const { return m_path; }
+
+    // 成功返回 0
+    int Read(long long* pValue);
+
+    int ReopenCount() const { return m_reopenCnt; }
+    int ErrorCount() const { return m_errorCnt; }
+
+private:
+    int Open();
+    void Close();
+    int ReadOnce(long long* pValue);
+
+    std::string m_path;
+    int         m_fd;
+    int         m_reopenCnt;
+    int         m_errorCnt;
+};
+
+// 一次性读取，不保留 fd
+int ReadSysfsInt(const char* path, long long* pValue);
+
+// 解析 sysfs 内容中的十进制整数，允许前导空白、负号和结尾换行
+int ParseSysfsInt(const char* buf, int len, long long* pValue);
+
+#endif // __SYSFS_READER_H__
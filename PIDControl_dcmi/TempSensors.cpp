@@ -0,0 +1,306 @@
+#include "TempSensors.h"
+#include "json.hpp"
+#include <dirent.h>
+#include <fnmatch.h>
+#include <syslog.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+
+using namespace std;
+using json = nlohmann::json;
+
+static string ReadLine(const string& path)
+{
+    string line;
+    ifstream file(path);
+
+    getline(file, line);
+    return line;
+}
+
+static bool MatchAny(const string& text, const char* const* patterns)
+{
+    for(int i = 0; patterns[i] != NULL; ++i)
+    {
+        if(fnmatch(patterns[i], text.c_str(), 0) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// 按 thermal zone 类型或 hwmon 芯片名分类，未知的归入 other，不参与缺省选择
+static SensorClass Classify(const string& name)
+{
+    static const char* const cpuPatterns[] = {
+        "*cpu*", "*soc*", "*cluster*", "x86_pkg_temp", "coretemp", "k10temp", "zenpower", NULL
+    };
+    static const char* const boardPatterns[] = {
+        "acpitz", "*board*", "pch_*", "nct*", "it8*", "f71*", "w83*", NULL
+    };
+
+    if(MatchAny(name, cpuPatterns))
+    {
+        return SENSOR_CPU;
+    }
+    if(MatchAny(name, boardPatterns))
+    {
+        return SENSOR_BOARD;
+    }
+    return SENSOR_OTHER;
+}
+
+static vector<string> ListDir(const char* path, const char* prefix)
+{
+    vector<string>  names;
+    DIR*            dir = opendir(path);
+
+    if(dir == NULL)
+    {
+        return names;
+    }
+
+    struct dirent* entry = NULL;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(strncmp(entry->d_name, prefix, strlen(prefix)) == 0)
+        {
+            names.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+
+    // 同名传感器的先后顺序与编号一致
+    sort(names.begin(), names.end());
+    return names;
+}
+
+vector<SensorInfo> DiscoverTempSensors()
+{
+    vector<SensorInfo> sensors;
+
+    vector<string> zones = ListDir(THERMAL_ROOT_PATH, "thermal_zone");
+    for(auto it = zones.begin(); it != zones.end(); ++it)
+    {
+        string      dir = string(THERMAL_ROOT_PATH) + "/" + *it;
+        string      type = ReadLine(dir + "/type");
+        SensorInfo  info;
+
+        if(type.empty() || access((dir + "/temp").c_str(), R_OK) != 0)
+        {
+            continue;
+        }
+
+        info.id = "thermal/" + type;
+        info.path = dir + "/temp";
+        info.cls = Classify(type);
+        sensors.push_back(info);
+    }
+
+    vector<string> chips = ListDir(HWMON_ROOT_PATH, "hwmon");
+    for(auto it = chips.begin(); it != chips.end(); ++it)
+    {
+        string      dir = string(HWMON_ROOT_PATH) + "/" + *it;
+        string      name = ReadLine(dir + "/name");
+        SensorClass cls = Classify(name);
+
+        vector<string> inputs = ListDir(dir.c_str(), "temp");
+        for(auto input = inputs.begin(); input != inputs.end(); ++input)
+        {
+            size_t pos = input->find("_input");
+            if(pos == string::npos || pos + 6 != input->size())
+            {
+                continue;
+            }
+
+            string      channel = input->substr(0, pos);
+            string      label = ReadLine(dir + "/" + channel + "_label");
+            SensorInfo  info;
+
+            info.id = "hwmon/" + name + "/" + (label.empty() ? channel : label);
+            info.path = dir + "/" + *input;
+            info.cls = cls;
+            sensors.push_back(info);
+        }
+    }
+
+    for(auto it = sensors.begin(); it != sensors.end(); ++it)
+    {
+        syslog(LOG_INFO, "[INFO] DiscoverTempSensors: %s -> %s, class %d.", it->id.c_str(), it->path.c_str(), it->cls);
+    }
+
+    return sensors;
+}
+
+
+// TempSensorGroup 成员函数
+TempSensorGroup::TempSensorGroup(const string& name)
+    : m_name(name), m_aggregate(SENSOR_AGG_MAX), m_percentile(100), m_configured(false)
+{
+
+}
+
+void TempSensorGroup::AddSensor(const string& id, const string& path, double weight)
+{
+    Member member;
+
+    member.id = id;
+    member.reader.reset(new SysfsReader(path));
+    member.weight = weight;
+    m_members.push_back(move(member));
+}
+
+void TempSensorGroup::Clear()
+{
+    m_members.clear();
+    m_configured = false;
+}
+
+int TempSensorGroup::Load(const vector<SensorInfo>& sensors, const char* configPath, SensorClass defaultClass)
+{
+    json            node = json::object();
+    vector<string>  match;
+
+    Clear();
+
+    ifstream file(configPath);
+    json root = json::parse(file, nullptr, false);
+    if(!root.is_discarded() && root.is_object() && root.contains("sensors") && root["sensors"].is_object()
+        && root["sensors"].contains(m_name) && root["sensors"][m_name].is_object())
+    {
+        node = root["sensors"][m_name];
+    }
+
+    if(node.contains("match") && node["match"].is_array())
+    {
+        for(auto it = node["match"].begin(); it != node["match"].end(); ++it)
+        {
+            if(it->is_string())
+            {
+                match.push_back(it->get<string>());
+            }
+        }
+        m_configured = !match.empty();
+    }
+
+    string aggregate = node.contains("aggregate") && node["aggregate"].is_string() ? node["aggregate"].get<string>() : "max";
+    if(aggregate == "mean")             m_aggregate = SENSOR_AGG_MEAN;
+    else if(aggregate == "wmean")       m_aggregate = SENSOR_AGG_WMEAN;
+    else if(aggregate == "percentile")  m_aggregate = SENSOR_AGG_PERCENTILE;
+    else
+    {
+        if(aggregate != "max")
+        {
+            syslog(LOG_INFO, "[ERROR] TempSensorGroup %s: Unknown aggregate %s, use max.", m_name.c_str(), aggregate.c_str());
+        }
+        m_aggregate = SENSOR_AGG_MAX;
+    }
+
+    if(node.contains("percentile") && node["percentile"].is_number())
+    {
+        m_percentile = max(0.0, min(node["percentile"].get<double>(), 100.0));
+    }
+
+    for(auto it = sensors.begin(); it != sensors.end(); ++it)
+    {
+        bool selected = false;
+        if(m_configured)
+        {
+            for(auto pattern = match.begin(); pattern != match.end() && !selected; ++pattern)
+            {
+                selected = fnmatch(pattern->c_str(), it->id.c_str(), 0) == 0;
+            }
+        }
+        else
+        {
+            selected = it->cls == defaultClass;
+        }
+
+        if(!selected)
+        {
+            continue;
+        }
+
+        // 第一个匹配的权重生效
+        double weight = 1;
+        if(node.contains("weights") && node["weights"].is_object())
+        {
+            for(auto w = node["weights"].begin(); w != node["weights"].end(); ++w)
+            {
+                if(w.value().is_number() && fnmatch(w.key().c_str(), it->id.c_str(), 0) == 0)
+                {
+                    weight = w.value().get<double>();
+                    break;
+                }
+            }
+        }
+
+        AddSensor(it->id, it->path, weight);
+        syslog(LOG_INFO, "[INFO] TempSensorGroup %s: use %s, weight %.2f.", m_name.c_str(), it->id.c_str(), weight);
+    }
+
+    syslog(LOG_INFO, "[INFO] TempSensorGroup %s: %d sensors, aggregate %s.", m_name.c_str(), (int)m_members.size(), aggregate.c_str());
+    return m_members.size();
+}
+
+int TempSensorGroup::Read(int* pTemp)
+{
+    vector<long long>   values;
+    double              sum = 0;
+    double              weightSum = 0;
+    long long           hottest = 0;
+    long long           result = 0;
+
+    for(auto it = m_members.begin(); it != m_members.end(); ++it)
+    {
+        long long value = 0;
+        if(it->reader->Read(&value) != 0)
+        {
+            continue;
+        }
+
+        if(values.empty() || value > hottest)
+        {
+            hottest = value;
+            m_hottestId = it->id;
+        }
+        values.push_back(value);
+        sum += (double)value * it->weight;
+        weightSum += it->weight;
+    }
+
+    if(values.empty())
+    {
+        return -1;
+    }
+
+    switch(m_aggregate)
+    {
+        case SENSOR_AGG_MEAN:
+            result = accumulate(values.begin(), values.end(), 0LL) / (long long)values.size();
+            break;
+        case SENSOR_AGG_WMEAN:
+            result = weightSum > 0 ? llround(sum / weightSum) : hottest;
+            break;
+        case SENSOR_AGG_PERCENTILE:
+        {
+            // 最近秩法：p100 即最大值
+            sort(values.begin(), values.end());
+            size_t rank = (size_t)ceil(m_percentile / 100 * values.size());
+            result = values[rank > 0 ? rank - 1 : 0];
+            break;
+        }
+        default:
+            result = hottest;
+            break;
+    }
+
+    *pTemp = result / 1000;
+    return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef __TEMP_SENSORS_H__
+#define __TEMP_SENSORS_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "SysfsReader.h"
+
+enum SensorClass
+{
+    SENSOR_CPU,
+    SENSOR_BOARD,
+    SENSOR_OTHER,
+};
+
+// 启动时发现的一个温度传感器
+// id 不含 thermal_zoneN / hwmonN 编号，重启后编号变化也能匹配：
+//   thermal/<type>，如 thermal/cluster0_thermal
+//   hwmon/<name>/<label>，没有 label 时为 tempN，如 hwmon/coretemp/Package id 0
+struct SensorInfo
+{
+    std::string id;
+    std::string path;
+    SensorClass cls;
+};
+
+// 枚举 /sys/class/thermal/thermal_zone*/temp 和 /sys/class/hwmon/*/temp*_input，按类型、芯片名分类
+std::vector<SensorInfo> DiscoverTempSensors();
+
+enum SensorAggregate
+{
+    SENSOR_AGG_MAX,
+    SENSOR_AGG_MEAN,
+    SENSOR_AGG_WMEAN,           // 按 weights 加权平均
+    SENSOR_AGG_PERCENTILE,
+};
+
+// 一个控制器使用的一组传感器及其聚合方式，来自配置文件的 "sensors".<name> 节点：
+//   {"match": ["thermal/*cpu*", "hwmon/coretemp/*"], "aggregate": "max|mean|wmean|percentile",
+//    "percentile": 90, "weights": {"hwmon/coretemp/Package*": 2}}
+// match、weights 的 key 为 fnmatch 通配符
+class TempSensorGroup
+{
+public:
+    TempSensorGroup(const std::string& name);
+
+    // 配置了 match 时按配置选择，否则选 defaultClass 类的全部传感器；返回选中的数量
+    int Load(const std::vector<SensorInfo>& sensors, const char* configPath, SensorClass defaultClass);
+    void AddSensor(const std::string& id, const std::string& path, double weight = 1);
+    void Clear();
+
+    bool Empty() const { return m_members.empty(); }
+    bool Configured() const { return m_configured; }
+    const std::string& Name() const { return m_name; }
+
+    // 读失败的传感器不参与聚合，全部失败返回非 0；单位 ℃
+    int Read(int* pTemp);
+    // 最近一次聚合中温度最高的传感器
+    const std::string& HottestId() const { return m_hottestId; }
+
+private:
+    struct Member
+    {
+        std::string                     id;
+        std::unique_ptr<SysfsReader>    reader;
+        double                          weight;
+    };
+
+    std::string             m_name;
+    std::vector<Member>     m_members;
+    SensorAggregate         m_aggregate;
+    double                  m_percentile;
+    bool                    m_configured;
+    std::string             m_hottestId;
+};
+
+#endif // __TEMP_SENSORS_H__
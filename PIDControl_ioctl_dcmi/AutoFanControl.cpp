@@ -114,14 +114,21 @@ int main()
     pthread_detach(paramsTid);
 
     bool                    resetFlag = false;
-    SysController           sysCtrl;
+    SioDevice               sioDev;
+    SysController           sysCtrl(&sioDev);
     int                     cardNum = 0;
     int                     cardList[8] = {0};
-    CardController          cardCtrl;
+    CardController          cardCtrl(&sioDev);
 
     
     IF_COND_FAIL(cardCtrl.Init(), "CardController.Init() fail, process exit", return -1);
 
+    // 回读校验策略，未配置或配置非法时使用 SIO_VERIFY_DEFAULT
+    sioDev.LoadVerifyConfig(MODE_FILE_PATH);
+
+    // 打开一次 /dev/aaeon_sio，之后长期持有，出错时自动重开；打开失败时每周期重试
+    IF_COND_FAIL(sioDev.Open() == 0, "[ERROR] Fail to open /dev/aaeon_sio, retry in next cycle", );
+
     while(true)
     {
         if(g_params.getMode())
@@ -137,6 +144,9 @@ int main()
 
             sysCtrl.SetPwm();
             cardCtrl.SetPwm();
+
+            // 本周期的 ioctl 连续提交
+            sioDev.Submit();
         }
         else
         {
@@ -56,8 +56,6 @@
 #define THRIDUO_INTEGRAL 0
 #define THRIDUO_MAX_POWER 1500    //单位：0.1W
 
-#define DEFAULT_FAN_MODE 2
-
 using namespace std;
 using namespace chrono;
 
@@ -75,48 +73,17 @@ string Int2StrPadZero(int value, int length)
 }
 
 
-int Pwm2Duty(int pwm)
-{
-    IF_COND_FAIL(pwm > 0 && pwm < 101, ("[ERROR] Pwm2Duty: Invalid pwm! Pwm is " + to_string(pwm)).data(), return 255);
-
-    int duty = pwm * 255 / 100;
-    return duty;
-}
-
-
-int Duty2Pwm(int duty)
-{
-    IF_COND_FAIL(duty > 0 && duty < 256, ("[ERROR] Duty2Pwm: Invalid duty! Duty is " + to_string(duty)).data(), return 100);
-
-    int pwm = duty * 100 / 255;
-    return pwm;
-}
-
-
-int ExecCommand(int cmd, void* pIn)
-{
-    int fd = open("/dev/aaeon_sio",O_RDWR);
-    IF_COND_FAIL(fd != -1, "[ERROR] Fail to open /dev/aaeon_sio!!!", return -1);
-
-    int ret = ioctl(fd, cmd, pIn);
-    IF_COND_FAIL(ret == 0, ("[ERROR] Failed to ioctl the command. cmd: "+ to_string(cmd)).data(), return ret;);
-
-    close(fd);
-    return 0;
-}
-
-
 // FanController 成员函数
-FanController::FanController()
-    : m_kp(0), m_ki(0), m_kd(0), m_integral(0), m_curPwm(0)
+FanController::FanController(SioDevice* pDev)
+    : m_kp(0), m_ki(0), m_kd(0), m_integral(0), m_curPwm(0), m_pDev(pDev)
 {
     m_prevError = 0;
     m_lastTime = steady_clock::now();
     m_criticalFlag = false;
 }
 
-FanController::FanController(double kp, double ki, double kd, double integral, int fd)
-    : m_kp(kp), m_ki(ki), m_kd(kd), m_integral(integral), m_curPwm(0)
+FanController::FanController(double kp, double ki, double kd, double integral, SioDevice* pDev)
+    : m_kp(kp), m_ki(ki), m_kd(kd), m_integral(integral), m_curPwm(0), m_pDev(pDev)
 {
     m_prevError = 0;
     m_lastTime = steady_clock::now();
@@ -148,8 +115,8 @@ void FanController::Reset()
     m_criticalFlag = false;
 }
 
-SysController::SysController()
-    : FanController()
+SysController::SysController(SioDevice* pDev)
+    : FanController(pDev)
 {
     m_kp = SYS_KP;
     m_ki = SYS_KI;
@@ -217,8 +184,6 @@ void SysController::SetPwm()
 {
     int             pwm = 0;
     float           curTemp = 0;
-    int             ret = -1;
-    sio_ioctl_data  cardData;
 
     pwm = CalcPwm(curTemp);
     if(m_curPwm == pwm)
@@ -226,18 +191,14 @@ void SysController::SetPwm()
         return;
     }
 
-    cardData.fan_num = 2;
-    cardData.fan_mode = DEFAULT_FAN_MODE;
-    cardData.duty = Pwm2Duty(pwm);
-    ret = ExecCommand(IOC_COMMAND_SET, &cardData);
-    IF_COND_FAIL(ret == 0, "[ERROR] Fail to set system pwm !!!", return;);
-    m_curPwm = pwm;
-    syslog(LOG_INFO, "[INFO] Set system pwm success, temperatrue: %f, current pwm is %d.", curTemp, pwm);
+    // 本周期结束时由 SioDevice::Submit 统一下发，是否回读由校验策略决定
+    m_pDev->QueueWrite(2, pwm, &m_curPwm, "system");
+    syslog(LOG_INFO, "[INFO] system temperatrue: %f, target pwm is %d.", curTemp, pwm);
 }
 
 // CardController 成员函数
-CardController::CardController()
-    : FanController(), m_cardList({0}), m_cardNum(0), m_busIdList({0}), m_initFlag(true)
+CardController::CardController(SioDevice* pDev)
+    : FanController(pDev), m_cardList({0}), m_cardNum(0), m_busIdList({0}), m_initFlag(true), m_hotCardId(-1), m_hotDevice(0)
 {
     int                         ret = 0;
     char                        product_type_str[64] = {0};
@@ -281,21 +242,25 @@ CardController::CardController()
             m_kdList[i] = THRV_KD;
         }
     }
+
+    // 各卡每个芯片的 dcmi 查询并行执行，周期耗时取决于最慢的一个芯片
+    m_pool.Start(m_cardList, m_cardNum);
 }
 
 float CardController::ReadTemp()
 {
-    int cardTemp = 0;
-    int ret = -1;
-    
-    for(int i = 0; i < m_cardNum; ++i)
+    int                 cardTemp = 0;
+    vector<CardSample>  samples = m_pool.Snapshot();
+
+    // 取本周期快照中的最高温度，不再逐卡串行查询；多芯片卡的温度已是最热芯片的 SoC/HBM 温度
+    for(auto it = samples.begin(); it != samples.end(); ++it)
     {
-        int readTemp = 0;
-        ret = dcmi_get_device_temperature(m_cardList[i], 0, &readTemp);
-        IF_COND_FAIL(ret == 0, string("[ERROR] CardController.ReadTemp: Fail to get Temp, cardId is " + to_string(m_cardList[i])).data(), continue;);
-        if(readTemp > cardTemp)
+        IF_COND_FAIL(it->tempRet == 0, string("[ERROR] CardController.ReadTemp: Fail to get Temp, cardId is " + to_string(it->cardId)).data(), continue;);
+        if(it->temp > cardTemp)
         {
-            cardTemp = readTemp;
+            cardTemp = it->temp;
+            m_hotCardId = it->cardId;
+            m_hotDevice = it->hotDevice;
         }
     }
     
@@ -362,10 +327,11 @@ int CardController::CalcPwm(int index, int& curTemp)
 
 void CardController::SetPwm()
 {
-    int             pwm = 0, readDuty = 0, readPwm = 0;
+    int             pwm = 0;
     int             curTemp = 0;
-    int             ret = -1;
-    sio_ioctl_data  cardData;
+
+    // 每周期只查询一轮，各卡的 CalcPwm 共用同一份快照
+    m_pool.Poll();
 
     for(int i = 0; i < m_cardNum; ++i)
     {
@@ -378,13 +344,7 @@ void CardController::SetPwm()
         return;
     }
 
-    cardData.fan_num = 3;
-    cardData.fan_mode = DEFAULT_FAN_MODE;
-    cardData.duty = Pwm2Duty(pwm);
-
-    ret = ExecCommand(IOC_COMMAND_SET, &cardData);
-    IF_COND_FAIL(ret == 0, "[ERROR] Fail to set cards pwm !!!", return;);
-    m_curPwm = pwm;
-    syslog(LOG_INFO, "[INFO] Set cards pwm success, temperatrue: %d, current pwm is %d.", curTemp, pwm);
+    m_pDev->QueueWrite(3, pwm, &m_curPwm, "cards");
+    syslog(LOG_INFO, "[INFO] cards temperatrue: %d (card %d device %d), target pwm is %d.", curTemp, m_hotCardId, m_hotDevice, pwm);
     // cout << "[INFO] Set cards pwm success, temperatrue: " << curTemp << ", current pwm: " << pwm << endl;;
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include <string>
 #include <shared_mutex>
 #include <mutex>
+#include "SioDevice.h"
+#include "CardTelemetry.h"
 
 #define MAX_CARD_NUM    8
 #define MODE_FILE_PATH  "/etc/FanControlParams.json"
@@ -29,18 +31,6 @@
         } while (0)
 #endif //_PRINT_SYS_LOG
 
-struct sio_ioctl_data {
-    unsigned char fan_num;
-    unsigned char fan_mode;
-    unsigned char duty;
-};
-
-#define IOC_MAGIC 'c'
-#define IOC_COMMAND_SET _IOW(IOC_MAGIC,0,struct sio_ioctl_data)
-#define IOC_COMMAND_GET _IOWR(IOC_MAGIC,1,int)
-#define IOC_COMMAND_RPM _IOWR(IOC_MAGIC,2,int)
-
-
 struct GlobalParams 
 {
     bool                autoFlag = false;
@@ -73,8 +63,8 @@ extern GlobalParams             g_params;
 class FanController
 {
 public:
-    FanController();
-    FanController(double kp, double ki, double kd, double integral, int fd);
+    FanController(SioDevice* pDev);
+    FanController(double kp, double ki, double kd, double integral, SioDevice* pDev);
     void Restart();
     virtual void SetPwm() = 0;
     void SetPidParams(double kp, double ki, double kd, double integral);
@@ -89,6 +79,7 @@ protected:
     int                                                 m_curTemp;
     bool                                                m_criticalFlag;
     int                                                 m_curPwm;
+    SioDevice*                                          m_pDev;
 
     // virtual int CalcPwm(float& curTemp);    
     virtual float ReadTemp() = 0;
@@ -99,7 +90,7 @@ protected:
 class SysController : public FanController
 {
 public:
-    SysController();
+    SysController(SioDevice* pDev);
     void SetPwm();
 
 protected:
@@ -114,7 +105,7 @@ private:
 class CardController : public FanController
 {
 public:
-    CardController();
+    CardController(SioDevice* pDev);
     void SetPwm();
     bool Init() { return m_initFlag; }
 
@@ -133,6 +124,9 @@ private:
     double                                              m_kdList[MAX_CARD_NUM];
     int                                                 m_busIdList[MAX_CARD_NUM];
     std::string                                         m_proTypeList[MAX_CARD_NUM];
+    CardTelemetryPool                                   m_pool;
+    int                                                 m_hotCardId;        //最近一次最高温所在的卡和芯片
+    int                                                 m_hotDevice;
 };
 
 #endif // __FAN_CONTROLLER_H__
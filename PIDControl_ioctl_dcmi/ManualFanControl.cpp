@@ -375,7 +375,9 @@ FILE_OK:
 
     //open
     int fd = 0, ret = 0;
-    fd = open("/dev/aaeon_sio",O_RDWR);
+    // 设置 AAEON_SIO_DEV 后改为打开模拟器设备
+    const char* sioPath = getenv("AAEON_SIO_DEV");
+    fd = open((sioPath != NULL && sioPath[0] != '\0') ? sioPath : "/dev/aaeon_sio", O_RDWR);
     if(fd == -1)
     {
         cout << "[ERROR] Fail to open /dev/aaeon_sio!" << endl;
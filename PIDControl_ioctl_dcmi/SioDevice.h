@@ -0,0 +1,134 @@
+#ifndef __SIO_DEVICE_H__
+#define __SIO_DEVICE_H__
+
+#include <sys/ioctl.h>
+#include <vector>
+
+#define SIO_DEV_PATH        "/dev/aaeon_sio"
+#define SIO_DEV_ENV         "AAEON_SIO_DEV"     //设置后改为打开该设备，用于连接 SioSim 模拟器
+#define SIO_MAX_OP_NUM      32
+#define SIO_NAME_LEN        32
+#define SIO_FAN_MAX         16
+
+struct sio_ioctl_data {
+    unsigned char fan_num;
+    unsigned char fan_mode;
+    unsigned char duty;
+};
+
+#define IOC_MAGIC 'c'
+#define IOC_COMMAND_SET _IOW(IOC_MAGIC,0,struct sio_ioctl_data)
+#define IOC_COMMAND_GET _IOWR(IOC_MAGIC,1,int)
+#define IOC_COMMAND_RPM _IOWR(IOC_MAGIC,2,int)
+
+const char* SioDevPath();
+int Pwm2Duty(int pwm);
+int Duty2Pwm(int duty);
+
+enum SioOpType
+{
+    SIO_OP_SET,
+    SIO_OP_GET,
+    SIO_OP_RPM,
+};
+
+// 回读校验策略，来自 /etc/FanControlParams.json 的 "sio_verify" 节点
+enum SioVerifyPolicy
+{
+    SIO_VERIFY_ALWAYS,          // 每次设置都回读
+    SIO_VERIFY_EVERY_N,         // 每个通道每 N 次设置回读一次
+    SIO_VERIFY_AFTER_ERROR,     // 只在出错后的升级期内回读
+    SIO_VERIFY_AUDIT,           // 设置不回读，每 N 个周期抽查一个通道
+};
+
+// 未配置 sio_verify 或配置非法时的策略，与原先只在 ioctl 出错时检查的行为一致
+#define SIO_VERIFY_DEFAULT          SIO_VERIFY_AFTER_ERROR
+#define SIO_VERIFY_DEFAULT_NAME     "after_error"
+
+struct SioVerifyConfig
+{
+    SioVerifyPolicy policy = SIO_VERIFY_DEFAULT;
+    int             interval = 10;
+    int             escalateWrites = 20;    // 出错后连续校验通过该次数才退回原策略
+};
+
+// 每个风扇通道的校验统计
+struct SioChannelStats
+{
+    int     writeCnt = 0;
+    int     verifyCnt = 0;
+    int     mismatchCnt = 0;
+    int     errorCnt = 0;
+    int     escalateLeft = 0;
+};
+
+// 长期持有 /dev/aaeon_sio 的 fd，出错时关闭并在下次调用时重新打开
+// 一个控制周期内的 SET/GET/RPM 先排队，Submit 时连续提交
+class SioDevice
+{
+public:
+    SioDevice();
+    ~SioDevice();
+
+    int Open();
+    void Close();
+
+    // 读取配置文件中的 "sio_verify" 节点，不存在或非法时使用 SIO_VERIFY_DEFAULT
+    int LoadVerifyConfig(const char* path);
+    void SetVerifyConfig(const SioVerifyConfig& config) { m_verifyConfig = config; }
+    const SioChannelStats& GetChannelStats(int fanNum) const;
+
+    // 按校验策略排队设置，需要回读时紧跟一个 GET，确认后才写入 pAckPwm
+    int QueueWrite(int fanNum, int pwm, int* pAckPwm, const char* name);
+
+    // SET 成功后把 pwm 写入 pAckPwm
+    int QueueSet(int fanNum, int pwm, int* pAckPwm, const char* name);
+    // GET 回读 duty，与 pwm 相差不超过 1 时把 pwm 写入 pAckPwm
+    int QueueVerify(int fanNum, int pwm, int* pAckPwm, const char* name);
+    int QueueRpm(int fanNum);
+    // 按排队顺序执行，返回失败的操作数；结果保留到下一次 Queue
+    int Submit();
+    int Result(int index) const;
+    int Value(int index) const;
+    int ReopenCount() const { return m_reopenCnt; }
+
+private:
+    struct Op
+    {
+        SioOpType   type;
+        int         fanNum;
+        int         pwm;
+        int*        pAckPwm;
+        char        name[SIO_NAME_LEN];
+        int         value;
+        int         ret;
+        bool        audit;
+    };
+
+    struct Channel
+    {
+        SioChannelStats stats;
+        int*            pAckPwm = nullptr;
+        int             ackedPwm = -1;
+        char            name[SIO_NAME_LEN] = {0};
+    };
+
+    int Queue(SioOpType type, int fanNum, int pwm, int* pAckPwm, const char* name);
+    bool NeedVerify(Channel& ch);
+    void QueueAudit();
+    void Escalate(Channel& ch, const char* reason);
+    void OnOpDone(Op& op, bool mismatch);
+    int Ioctl(unsigned long cmd, void* pArg);
+    int Exec(Op& op);
+
+    int                 m_fd;
+    int                 m_reopenCnt;
+    bool                m_submitted;
+    std::vector<Op>     m_ops;
+    SioVerifyConfig     m_verifyConfig;
+    Channel             m_channels[SIO_FAN_MAX];
+    int                 m_cycleCnt;
+    int                 m_auditNext;
+};
+
+#endif // __SIO_DEVICE_H__
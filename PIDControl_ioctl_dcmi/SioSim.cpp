@@ -0,0 +1,262 @@
+// aaeon_sio 驱动模拟器：用 CUSE 在用户态创建字符设备，实现 IOC_COMMAND_SET / GET / RPM
+// 用法：SioSim [-n 设备名] [-l ioctl延迟us] [-j 抖动us] [-x 出错概率] [-m 满转转速] [-c 转速时间常数s] [-f] [-s] [-d]
+// 需要 root 权限和 /dev/cuse；默认创建 /dev/aaeon_sio_sim，然后以 AAEON_SIO_DEV=/dev/aaeon_sio_sim 运行 AutoFanCtrl / ManFanCtrl
+#define FUSE_USE_VERSION 31
+
+#include <cuse_lowlevel.h>
+#include <fuse_opt.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cmath>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "SioDevice.h"
+
+using namespace std;
+using namespace chrono;
+
+#define SIM_FAN_NUM         SIO_FAN_MAX
+
+struct SimConfig
+{
+    string  devName = "aaeon_sio_sim";
+    int     latencyUs = 50;
+    int     jitterUs = 0;
+    double  errorRate = 0;
+    int     maxRpm = 6000;
+    double  rpmTau = 2.0;
+};
+
+struct SimStats
+{
+    long long   setCnt = 0;
+    long long   getCnt = 0;
+    long long   rpmCnt = 0;
+    long long   errorCnt = 0;
+};
+
+static SimConfig                s_cfg;
+static SimStats                 s_stats;
+static mutex                    s_mutex;
+static int                      s_duty[SIM_FAN_NUM] = {0};
+static double                   s_rpm[SIM_FAN_NUM] = {0};
+static steady_clock::time_point s_lastUpdate = steady_clock::now();
+static mt19937                  s_rng(12345);
+
+static int GetHelp()
+{
+    cout << "SioSim [-n dev_name] [-l latency_us] [-j jitter_us] [-x error_rate] [-m max_rpm] [-c rpm_tau_s] [-f] [-s] [-d]" << endl;
+    cout << "-f foreground, -s single thread, -d fuse debug (implies -f), passed through to CUSE" << endl;
+    cout << "Then run: AAEON_SIO_DEV=/dev/<dev_name> AutoFanCtrl" << endl;
+    return 0;
+}
+
+// 解析自己的参数，CUSE 的 -f（前台）、-s（单线程）、-d（调试）原样传入
+static int ParseArgs(int argc, char* argv[], vector<char*>& cuseArgs)
+{
+    cuseArgs.push_back(argv[0]);
+
+    for(int i = 1; i < argc; ++i)
+    {
+        string opt = argv[i];
+        if(opt == "-h")
+        {
+            GetHelp();
+            exit(0);
+        }
+
+        if(opt == "-f" || opt == "-s" || opt == "-d")
+        {
+            cuseArgs.push_back(argv[i]);
+            continue;
+        }
+
+        if(i + 1 >= argc)
+        {
+            cout << "[ERROR] Missing value for " << opt << endl;
+            return -1;
+        }
+
+        const char* value = argv[++i];
+        if(opt == "-n")         s_cfg.devName = value;
+        else if(opt == "-l")    s_cfg.latencyUs = atoi(value);
+        else if(opt == "-j")    s_cfg.jitterUs = atoi(value);
+        else if(opt == "-x")    s_cfg.errorRate = atof(value);
+        else if(opt == "-m")    s_cfg.maxRpm = atoi(value);
+        else if(opt == "-c")    s_cfg.rpmTau = atof(value);
+        else
+        {
+            cout << "[ERROR] Unknown option " << opt << endl;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// 转速按一阶惯性逼近 duty 对应的目标转速，每次 ioctl 时按经过的时间推进
+static void UpdateRpm()
+{
+    auto    now = steady_clock::now();
+    double  dtSec = duration<double>(now - s_lastUpdate).count();
+    double  alpha = s_cfg.rpmTau > 0 ? 1 - exp(-dtSec / s_cfg.rpmTau) : 1;
+
+    for(int i = 0; i < SIM_FAN_NUM; ++i)
+    {
+        double target = (double)s_cfg.maxRpm * s_duty[i] / 255;
+        s_rpm[i] += (target - s_rpm[i]) * alpha;
+    }
+
+    s_lastUpdate = now;
+}
+
+// 在锁外模拟驱动的处理耗时，返回 true 表示本次注入错误
+static bool SimulateLatency()
+{
+    int     delayUs = s_cfg.latencyUs;
+    bool    fail = false;
+
+    {
+        lock_guard<mutex> lock(s_mutex);
+        if(s_cfg.jitterUs > 0)
+        {
+            delayUs += uniform_int_distribution<int>(0, s_cfg.jitterUs)(s_rng);
+        }
+        fail = s_cfg.errorRate > 0 && uniform_real_distribution<double>(0, 1)(s_rng) < s_cfg.errorRate;
+    }
+
+    if(delayUs > 0)
+    {
+        usleep(delayUs);
+    }
+
+    return fail;
+}
+
+static void SioOpen(fuse_req_t req, struct fuse_file_info* fi)
+{
+    fuse_reply_open(req, fi);
+}
+
+// 未设置 CUSE_UNRESTRICTED_IOCTL，内核按命令号里的方向和大小拷贝参数
+static void SioIoctl(fuse_req_t req, int cmd, void* arg, struct fuse_file_info* fi, unsigned flags,
+    const void* inBuf, size_t inBufSize, size_t outBufSize)
+{
+    if(flags & FUSE_IOCTL_COMPAT)
+    {
+        fuse_reply_err(req, ENOSYS);
+        return;
+    }
+
+    if(SimulateLatency())
+    {
+        lock_guard<mutex> lock(s_mutex);
+        ++s_stats.errorCnt;
+        fuse_reply_err(req, EIO);
+        return;
+    }
+
+    lock_guard<mutex> lock(s_mutex);
+    UpdateRpm();
+
+    switch((unsigned int)cmd)
+    {
+        case IOC_COMMAND_SET:
+        {
+            if(inBufSize < sizeof(sio_ioctl_data))
+            {
+                fuse_reply_err(req, EINVAL);
+                return;
+            }
+
+            const sio_ioctl_data* pData = (const sio_ioctl_data*)inBuf;
+            if(pData->fan_num >= SIM_FAN_NUM)
+            {
+                fuse_reply_err(req, EINVAL);
+                return;
+            }
+
+            s_duty[pData->fan_num] = pData->duty;
+            ++s_stats.setCnt;
+            fuse_reply_ioctl(req, 0, NULL, 0);
+            return;
+        }
+        case IOC_COMMAND_GET:
+        case IOC_COMMAND_RPM:
+        {
+            // 传入风扇号，原地返回 duty / 转速
+            if(inBufSize < sizeof(int) || outBufSize < sizeof(int))
+            {
+                fuse_reply_err(req, EINVAL);
+                return;
+            }
+
+            int fanNum = *(const int*)inBuf;
+            if(fanNum < 0 || fanNum >= SIM_FAN_NUM)
+            {
+                fuse_reply_err(req, EINVAL);
+                return;
+            }
+
+            int value = 0;
+            if((unsigned int)cmd == IOC_COMMAND_GET)
+            {
+                value = s_duty[fanNum];
+                ++s_stats.getCnt;
+            }
+            else
+            {
+                value = (int)lround(s_rpm[fanNum]);
+                ++s_stats.rpmCnt;
+            }
+
+            fuse_reply_ioctl(req, 0, &value, sizeof(value));
+            return;
+        }
+        default:
+            fuse_reply_err(req, ENOTTY);
+            return;
+    }
+}
+
+static const struct cuse_lowlevel_ops s_ops = {
+    .open = SioOpen,
+    .ioctl = SioIoctl,
+};
+
+int main(int argc, char* argv[])
+{
+    vector<char*>           cuseArgs;
+    struct cuse_info        ci;
+    string                  devInfo;
+    const char*             devInfoArgv[1];
+
+    if(ParseArgs(argc, argv, cuseArgs) != 0)
+    {
+        GetHelp();
+        return -1;
+    }
+
+    devInfo = "DEVNAME=" + s_cfg.devName;
+    devInfoArgv[0] = devInfo.c_str();
+
+    memset(&ci, 0, sizeof(ci));
+    ci.dev_info_argc = 1;
+    ci.dev_info_argv = devInfoArgv;
+
+    cout << "SioSim ready on /dev/" << s_cfg.devName << ", latency " << s_cfg.latencyUs << " us, jitter " << s_cfg.jitterUs
+         << " us, error rate " << s_cfg.errorRate << endl;
+
+    int ret = cuse_lowlevel_main(cuseArgs.size(), cuseArgs.data(), &ci, &s_ops, NULL);
+
+    cout << "SioSim exit, set: " << s_stats.setCnt << ", get: " << s_stats.getCnt << ", rpm: " << s_stats.rpmCnt
+         << ", injected errors: " << s_stats.errorCnt << endl;
+    return ret;
+}
@@ -118,6 +118,8 @@ int main()
     int                     cardNum = 0;
     int                     cardList[8] = {0};
     vector<CardController>  cardCtrlVec;
+    SioDevice               sioDev;
+    CardTelemetryPool       cardPool;
 
     ret = dcmi_init();
     IF_COND_FAIL(ret == 0, "[ERROR] dcmi_init fail, process exit", return -1;);
@@ -128,10 +130,19 @@ int main()
 
     for(int i = 0; i < cardNum; ++i)
     {
-        CardController item(cardList[i]);
+        CardController item(&sioDev, cardList[i], &cardPool);
         cardCtrlVec.push_back(item);
     }
 
+    // 各卡每个芯片的 dcmi 查询并行执行，周期耗时取决于最慢的一个芯片
+    cardPool.Start(cardList, cardNum);
+
+    // 回读校验策略，未配置或配置非法时使用 SIO_VERIFY_DEFAULT
+    sioDev.LoadVerifyConfig(MODE_FILE_PATH);
+
+    // 打开一次 /dev/aaeon_sio，之后长期持有，出错时自动重开；打开失败时每周期重试
+    IF_COND_FAIL(sioDev.Open() == 0, "[ERROR] Fail to open /dev/aaeon_sio, retry in next cycle", );
+
     while(true)
     {
         if(g_params.getMode())
@@ -147,10 +158,15 @@ int main()
                 resetFlag = false;
             }
 
+            // 每周期只查询一轮，各卡控制器共用同一份快照
+            cardPool.Poll();
             for(auto it = cardCtrlVec.begin(); it != cardCtrlVec.end(); ++it)
             {
                 it->SetPwm();
             }
+
+            // 本周期的 ioctl 连续提交
+            sioDev.Submit();
         }
         else
         {
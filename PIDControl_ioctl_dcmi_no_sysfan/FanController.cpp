@@ -55,8 +55,6 @@
 #define THRIDUO_INTEGRAL 0
 #define THRIDUO_MAX_POWER 1500    //单位：0.1W
 
-#define DEFAULT_FAN_MODE 2
-
 using namespace std;
 using namespace chrono;
 
@@ -74,23 +72,6 @@ string Int2StrPadZero(int value, int length)
 }
 
 
-int Pwm2Duty(int pwm)
-{
-    IF_COND_FAIL(pwm > 0 && pwm < 101, ("[ERROR] Pwm2Duty: Invalid pwm! Pwm is " + to_string(pwm)).data(), return 255);
-
-    int duty = pwm * 255 / 100;
-    return duty;
-}
-
-
-int Duty2Pwm(int duty)
-{
-    IF_COND_FAIL(duty > 0 && duty < 256, ("[ERROR] Duty2Pwm: Invalid duty! Duty is " + to_string(duty)).data(), return 100);
-
-    int pwm = duty * 100 / 255;
-    return pwm;
-}
-
 float ReadCpuTemp()
 {
     float cpuTemp = CRITICAL_TEMP;
@@ -109,30 +90,17 @@ float ReadCpuTemp()
 
 
 
-int ExecCommand(int cmd, void* pIn)
-{
-    int fd = open("/dev/aaeon_sio",O_RDWR);
-    IF_COND_FAIL(fd != -1, "[ERROR] Fail to open /dev/aaeon_sio!!!", return -1);
-
-    int ret = ioctl(fd, cmd, pIn);
-    IF_COND_FAIL(ret == 0, ("[ERROR] Failed to ioctl the command. cmd: "+ to_string(cmd)).data(), return ret;);
-
-    close(fd);
-    return 0;
-}
-
-
 // FanController 成员函数
-FanController::FanController()
-    : m_kp(0), m_ki(0), m_kd(0), m_integral(0), m_curPwm(0)
+FanController::FanController(SioDevice* pDev)
+    : m_kp(0), m_ki(0), m_kd(0), m_integral(0), m_curPwm(0), m_pDev(pDev)
 {
     m_prevError = 0;
     m_lastTime = steady_clock::now();
     m_criticalFlag = false;
 }
 
-FanController::FanController(double kp, double ki, double kd, double integral, int fd)
-    : m_kp(kp), m_ki(ki), m_kd(kd), m_integral(integral), m_curPwm(0)
+FanController::FanController(double kp, double ki, double kd, double integral, SioDevice* pDev)
+    : m_kp(kp), m_ki(ki), m_kd(kd), m_integral(integral), m_curPwm(0), m_pDev(pDev)
 {
     m_prevError = 0;
     m_lastTime = steady_clock::now();
@@ -206,8 +174,8 @@ int FanController::CalcPwm(float& curTemp)
 }
 
 // CardController 成员函数
-CardController::CardController(int cardId)
-    : FanController(), m_cardId(cardId) 
+CardController::CardController(SioDevice* pDev, int cardId, CardTelemetryPool* pPool)
+    : FanController(pDev), m_cardId(cardId), m_pPool(pPool), m_hotDevice(0)
 {
     int                         ret = 0;
     char                        product_type_str[64] = {0};
@@ -247,12 +215,37 @@ CardController::CardController(int cardId)
 float CardController::ReadTemp()
 {
     int cardTemp = CRITICAL_TEMP;
+    int hotTemp = 0;
+    int deviceNum = 1;
     int ret = -1;
-    
-    ret = dcmi_get_device_temperature(m_cardId, 0, &cardTemp);
-    IF_COND_FAIL(ret == 0, string("[ERROR] CardController.ReadTemp: Fail to get Temp, error code is " + to_string(ret)).data(), return cardTemp);
+    CardSample cardSample;
+
+    // 使用本周期并行查询的快照，多芯片卡的温度已是最热芯片的温度
+    if(m_pPool != NULL && m_pPool->GetSample(m_cardId, cardSample))
+    {
+        IF_COND_FAIL(cardSample.tempRet == 0, string("[ERROR] CardController.ReadTemp: Fail to get Temp, error code is " + to_string(cardSample.tempRet)).data(), return CRITICAL_TEMP);
+        m_hotDevice = cardSample.hotDevice;
+        return cardSample.temp;
+    }
 
-    return cardTemp;
+    // 多芯片卡（Atlas 300I Duo）取最热的芯片，任一芯片读取失败按超温处理
+    if(dcmi_get_device_num_in_card(m_cardId, &deviceNum) != 0 || deviceNum <= 0)
+    {
+        deviceNum = 1;
+    }
+
+    for(int device = 0; device < deviceNum; ++device)
+    {
+        ret = dcmi_get_device_temperature(m_cardId, device, &cardTemp);
+        IF_COND_FAIL(ret == 0, string("[ERROR] CardController.ReadTemp: Fail to get device " + to_string(device) + " Temp, error code is " + to_string(ret)).data(), return CRITICAL_TEMP);
+        if(device == 0 || cardTemp > hotTemp)
+        {
+            hotTemp = cardTemp;
+            m_hotDevice = device;
+        }
+    }
+
+    return hotTemp;
 }
 
 
@@ -310,10 +303,10 @@ int CardController::CalcPwm(int& curTemp)
 
 void CardController::SetPwm()
 {
-    int             pwm = 0, readDuty = 0, readPwm = 0;
+    int             pwm = 0;
     int             curTemp = 0;
-    int             ret = -1;
     vector<int>     busIdVec;
+    char            name[32] = {0};
 
     pwm = CalcPwm(curTemp);
     if(m_curPwm == pwm)
@@ -326,30 +319,20 @@ void CardController::SetPwm()
     {
         if(*it == m_busId || *it == -2)
         {
-            sio_ioctl_data   cardData;
             int              index = it - busIdVec.begin();
+            int              setPwm = pwm;
 
             if(*it == -2)
             {
-                pwm = 30;
+                setPwm = 30;
                 syslog(LOG_INFO, "[INFO] Config set %s bus_id -2, pwm 30.", m_proType.data());
             }
 
-            cardData.fan_num = index + 2;
-            cardData.fan_mode = DEFAULT_FAN_MODE;
-            cardData.duty = Pwm2Duty(pwm);
-
-            ret = ExecCommand(IOC_COMMAND_SET, &cardData);
-            IF_COND_FAIL(ret == 0, ("[ERROR] Fail to set " + m_proType + " pwm !!!").data(), continue);
-            // 检查是否设置成功
-            readDuty = cardData.fan_num;
-            ret = ExecCommand(IOC_COMMAND_GET, &readDuty);
-            readPwm = Duty2Pwm(readDuty);
-            IF_COND_FAIL(ret == 0, ("[ERROR] Fail to get AI_CARD" + to_string((it - busIdVec.begin()) + 1) + " pwm !!!").data(), continue;);
-            IF_COND_FAIL(pwm == readPwm || pwm == readPwm + 1 || pwm == readPwm -1, ("[ERROR] AI_CARD" + to_string((it - busIdVec.begin()) + 1) + " pwm != readPwm !!! setPwm is " + to_string(pwm) + ", readPwm is " + to_string(readPwm) + ", duty is " + to_string(readDuty)).data(), continue;);
-
-            m_curPwm = pwm;
-            syslog(LOG_INFO, "[INFO] Set %s pwm success, card_id is %d, bus_is is %d, temperatrue: %d, current pwm is %d.", m_proType.data(), m_cardId, m_busId, curTemp, pwm);
+            // 本周期结束时由 SioDevice::Submit 统一下发，是否回读由校验策略决定
+            snprintf(name, sizeof(name), "AI_CARD%d", index + 1);
+            m_pDev->QueueWrite(index + 2, setPwm, &m_curPwm, name);
+
+            syslog(LOG_INFO, "[INFO] %s card_id is %d, bus_is is %d, temperatrue: %d (device %d), target pwm is %d.", m_proType.data(), m_cardId, m_busId, curTemp, m_hotDevice, setPwm);
             // cout << "[INFO] " << m_proType << " card_id is " << m_cardId << ", temperatrue:" << curTemp << endl;
             // cout << "[INFO] Set " << m_proType << " pwm success, bus_id is " << m_busId << ", current pwm: " << pwm << endl;
         }
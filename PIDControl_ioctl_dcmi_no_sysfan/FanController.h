@@ -6,6 +6,8 @@
 #include <string>
 #include <shared_mutex>
 #include <mutex>
+#include "SioDevice.h"
+#include "CardTelemetry.h"
 
 #define MODE_FILE_PATH  "/etc/FanControlParams.json"
 #define _PRINT_SYS_LOG
@@ -28,18 +30,6 @@
         } while (0)
 #endif //_PRINT_SYS_LOG
 
-struct sio_ioctl_data {
-    unsigned char fan_num;
-    unsigned char fan_mode;
-    unsigned char duty;
-};
-
-#define IOC_MAGIC 'c'
-#define IOC_COMMAND_SET _IOW(IOC_MAGIC,0,struct sio_ioctl_data)
-#define IOC_COMMAND_GET _IOWR(IOC_MAGIC,1,int)
-#define IOC_COMMAND_RPM _IOWR(IOC_MAGIC,2,int)
-
-
 struct GlobalParams 
 {
     bool                autoFlag = false;
@@ -71,8 +61,8 @@ extern GlobalParams             g_params;
 class FanController
 {
 public:
-    FanController();
-    FanController(double kp, double ki, double kd, double integral, int fd);
+    FanController(SioDevice* pDev);
+    FanController(double kp, double ki, double kd, double integral, SioDevice* pDev);
     void Restart();
     virtual void SetPwm() = 0;
     void SetPidParams(double kp, double ki, double kd, double integral);
@@ -87,6 +77,7 @@ protected:
     int                                                 m_curTemp;
     bool                                                m_criticalFlag;
     int                                                 m_curPwm;
+    SioDevice*                                          m_pDev;
 
     virtual int CalcPwm(float& curTemp);    
     virtual float ReadTemp() = 0;
@@ -97,7 +88,8 @@ protected:
 class CardController : public FanController
 {
 public:
-    CardController(int cardId);
+    // pPool 非空时从本周期的并行查询快照中取温度，否则直接调用 dcmi
+    CardController(SioDevice* pDev, int cardId, CardTelemetryPool* pPool = NULL);
     void SetPwm();
 
 protected:
@@ -110,6 +102,8 @@ private:
     bool                                                m_fullFlag;
     int                                                 m_busId;
     std::string                                         m_proType;
+    CardTelemetryPool*                                  m_pPool;
+    int                                                 m_hotDevice;        //最近一次最高温所在的芯片
 };
 
 #endif // __FAN_CONTROLLER_H__
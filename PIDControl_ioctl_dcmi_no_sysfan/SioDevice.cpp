@@ -0,0 +1,427 @@
+#include "SioDevice.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+#include "json.hpp"
+
+#define DEFAULT_FAN_MODE 2
+
+using namespace std;
+using json = nlohmann::json;
+
+const char* SioDevPath()
+{
+    const char* path = getenv(SIO_DEV_ENV);
+
+    return (path != NULL && path[0] != '\0') ? path : SIO_DEV_PATH;
+}
+
+int Pwm2Duty(int pwm)
+{
+    if(pwm <= 0 || pwm > 100)
+    {
+        syslog(LOG_INFO, "[ERROR] Pwm2Duty: Invalid pwm! Pwm is %d", pwm);
+        return 255;
+    }
+
+    int duty = pwm * 255 / 100;
+    return duty;
+}
+
+int Duty2Pwm(int duty)
+{
+    if(duty <= 0 || duty > 255)
+    {
+        syslog(LOG_INFO, "[ERROR] Duty2Pwm: Invalid duty! Duty is %d", duty);
+        return 100;
+    }
+
+    int pwm = duty * 100 / 255;
+    return pwm;
+}
+
+SioDevice::SioDevice()
+    : m_fd(-1), m_reopenCnt(0), m_submitted(false), m_cycleCnt(0), m_auditNext(0)
+{
+    m_ops.reserve(SIO_MAX_OP_NUM);
+}
+
+SioDevice::~SioDevice()
+{
+    Close();
+}
+
+int SioDevice::Open()
+{
+    if(m_fd >= 0)
+    {
+        return 0;
+    }
+
+    m_fd = open(SioDevPath(), O_RDWR | O_CLOEXEC);
+    if(m_fd < 0)
+    {
+        syslog(LOG_INFO, "[ERROR] SioDevice: Fail to open %s, errno %d.", SioDevPath(), errno);
+        return -1;
+    }
+
+    return 0;
+}
+
+void SioDevice::Close()
+{
+    if(m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+int SioDevice::LoadVerifyConfig(const char* path)
+{
+    SioVerifyConfig config;
+    ifstream        file(path);
+    json            root;
+
+    if(!file.is_open())
+    {
+        return 0;
+    }
+
+    root = json::parse(file, nullptr, false);
+    if(root.is_discarded() || !root.is_object() || !root.contains("sio_verify"))
+    {
+        return 0;
+    }
+
+    const json& node = root["sio_verify"];
+    if(!node.is_object())
+    {
+        syslog(LOG_INFO, "[ERROR] LoadVerifyConfig: sio_verify is not object type, use %s.", SIO_VERIFY_DEFAULT_NAME);
+        return -1;
+    }
+
+    string policy = node.value("policy", string(SIO_VERIFY_DEFAULT_NAME));
+    if(policy == "always")              config.policy = SIO_VERIFY_ALWAYS;
+    else if(policy == "every_n")        config.policy = SIO_VERIFY_EVERY_N;
+    else if(policy == "after_error")    config.policy = SIO_VERIFY_AFTER_ERROR;
+    else if(policy == "audit")          config.policy = SIO_VERIFY_AUDIT;
+    else
+    {
+        syslog(LOG_INFO, "[ERROR] LoadVerifyConfig: Unknown policy %s, use %s.", policy.data(), SIO_VERIFY_DEFAULT_NAME);
+        return -1;
+    }
+
+    if(node.contains("interval") && node["interval"].is_number_integer())               config.interval = node["interval"];
+    if(node.contains("escalate_writes") && node["escalate_writes"].is_number_integer()) config.escalateWrites = node["escalate_writes"];
+    if(config.interval <= 0 || config.escalateWrites <= 0)
+    {
+        syslog(LOG_INFO, "[ERROR] LoadVerifyConfig: interval and escalate_writes must be > 0, use %s.", SIO_VERIFY_DEFAULT_NAME);
+        return -1;
+    }
+
+    m_verifyConfig = config;
+    syslog(LOG_INFO, "[INFO] LoadVerifyConfig: policy %s, interval %d, escalate_writes %d.", policy.data(), config.interval,
+        config.escalateWrites);
+    return 0;
+}
+
+const SioChannelStats& SioDevice::GetChannelStats(int fanNum) const
+{
+    static const SioChannelStats empty;
+
+    return (fanNum >= 0 && fanNum < SIO_FAN_MAX) ? m_channels[fanNum].stats : empty;
+}
+
+// 设备被移除或驱动重载后旧 fd 失效，关闭重开后重试一次
+int SioDevice::Ioctl(unsigned long cmd, void* pArg)
+{
+    for(int retry = 0; retry < 2; ++retry)
+    {
+        if(Open() != 0)
+        {
+            return -1;
+        }
+
+        int ret = ioctl(m_fd, cmd, pArg);
+        if(ret == 0)
+        {
+            return 0;
+        }
+
+        if(errno != EBADF && errno != ENODEV && errno != ENXIO && errno != EIO)
+        {
+            syslog(LOG_INFO, "[ERROR] Failed to ioctl the command. cmd: %lu, errno %d", cmd, errno);
+            return ret;
+        }
+
+        syslog(LOG_INFO, "[ERROR] SioDevice: ioctl errno %d, reopen %s.", errno, SioDevPath());
+        Close();
+        ++m_reopenCnt;
+    }
+
+    return -1;
+}
+
+int SioDevice::Queue(SioOpType type, int fanNum, int pwm, int* pAckPwm, const char* name)
+{
+    // 上一批的结果取走后开始新的一批
+    if(m_submitted)
+    {
+        m_ops.clear();
+        m_submitted = false;
+    }
+
+    if(m_ops.size() >= SIO_MAX_OP_NUM)
+    {
+        syslog(LOG_INFO, "[ERROR] SioDevice: Too many queued operations, drop fan %d.", fanNum);
+        return -1;
+    }
+
+    Op op;
+    op.type = type;
+    op.fanNum = fanNum;
+    op.pwm = pwm;
+    op.pAckPwm = pAckPwm;
+    snprintf(op.name, sizeof(op.name), "%s", name != NULL ? name : "");
+    op.value = 0;
+    op.ret = -1;
+    op.audit = false;
+    m_ops.push_back(op);
+
+    return m_ops.size() - 1;
+}
+
+int SioDevice::QueueSet(int fanNum, int pwm, int* pAckPwm, const char* name)
+{
+    return Queue(SIO_OP_SET, fanNum, pwm, pAckPwm, name);
+}
+
+int SioDevice::QueueVerify(int fanNum, int pwm, int* pAckPwm, const char* name)
+{
+    return Queue(SIO_OP_GET, fanNum, pwm, pAckPwm, name);
+}
+
+bool SioDevice::NeedVerify(Channel& ch)
+{
+    // 出错后的升级期内每次都校验
+    if(ch.stats.escalateLeft > 0)
+    {
+        return true;
+    }
+
+    switch(m_verifyConfig.policy)
+    {
+        case SIO_VERIFY_ALWAYS:
+            return true;
+        case SIO_VERIFY_EVERY_N:
+            return (ch.stats.writeCnt - 1) % m_verifyConfig.interval == 0;
+        default:
+            return false;
+    }
+}
+
+int SioDevice::QueueWrite(int fanNum, int pwm, int* pAckPwm, const char* name)
+{
+    if(fanNum < 0 || fanNum >= SIO_FAN_MAX)
+    {
+        syslog(LOG_INFO, "[ERROR] SioDevice: Invalid fan number %d.", fanNum);
+        return -1;
+    }
+
+    Channel& ch = m_channels[fanNum];
+    ch.pAckPwm = pAckPwm;
+    snprintf(ch.name, sizeof(ch.name), "%s", name != NULL ? name : "");
+    ++ch.stats.writeCnt;
+
+    if(!NeedVerify(ch))
+    {
+        return QueueSet(fanNum, pwm, pAckPwm, name);
+    }
+
+    ++ch.stats.verifyCnt;
+    QueueSet(fanNum, pwm, NULL, name);
+    return QueueVerify(fanNum, pwm, pAckPwm, name);
+}
+
+// 抽查不占用设置路径：每 interval 个周期在本批末尾轮流回读一个已确认的通道
+void SioDevice::QueueAudit()
+{
+    if(m_verifyConfig.policy != SIO_VERIFY_AUDIT || ++m_cycleCnt % m_verifyConfig.interval != 0)
+    {
+        return;
+    }
+
+    for(int i = 0; i < SIO_FAN_MAX; ++i)
+    {
+        int fanNum = (m_auditNext + i) % SIO_FAN_MAX;
+        Channel& ch = m_channels[fanNum];
+        if(ch.ackedPwm < 0)
+        {
+            continue;
+        }
+
+        int index = Queue(SIO_OP_GET, fanNum, ch.ackedPwm, NULL, ch.name);
+        if(index >= 0)
+        {
+            m_ops[index].audit = true;
+            ++ch.stats.verifyCnt;
+        }
+        m_auditNext = fanNum + 1;
+        return;
+    }
+}
+
+void SioDevice::Escalate(Channel& ch, const char* reason)
+{
+    if(ch.stats.escalateLeft == 0)
+    {
+        syslog(LOG_INFO, "[ERROR] %s %s, escalate to full verification for %d writes.", ch.name, reason, m_verifyConfig.escalateWrites);
+    }
+    ch.stats.escalateLeft = m_verifyConfig.escalateWrites;
+}
+
+void SioDevice::OnOpDone(Op& op, bool mismatch)
+{
+    if(op.fanNum < 0 || op.fanNum >= SIO_FAN_MAX || op.type == SIO_OP_RPM)
+    {
+        return;
+    }
+
+    Channel& ch = m_channels[op.fanNum];
+    if(op.ret == 0)
+    {
+        if(op.pAckPwm != NULL)
+        {
+            ch.ackedPwm = op.pwm;
+        }
+
+        if(op.type == SIO_OP_GET && ch.stats.escalateLeft > 0 && --ch.stats.escalateLeft == 0)
+        {
+            syslog(LOG_INFO, "[INFO] %s readback healthy again, back to configured verification policy.", ch.name);
+        }
+        return;
+    }
+
+    // 回读本身失败不算不一致，按 ioctl 出错处理
+    if(!mismatch)
+    {
+        ++ch.stats.errorCnt;
+        Escalate(ch, "ioctl error");
+        return;
+    }
+
+    ++ch.stats.mismatchCnt;
+    Escalate(ch, "readback mismatch");
+
+    // 抽查发现不一致：让控制器下个周期重新下发
+    if(op.audit && ch.pAckPwm != NULL)
+    {
+        *ch.pAckPwm = 0;
+        ch.ackedPwm = -1;
+    }
+}
+
+int SioDevice::QueueRpm(int fanNum)
+{
+    return Queue(SIO_OP_RPM, fanNum, -1, NULL, NULL);
+}
+
+int SioDevice::Exec(Op& op)
+{
+    if(op.type == SIO_OP_SET)
+    {
+        sio_ioctl_data data;
+        data.fan_num = op.fanNum;
+        data.fan_mode = DEFAULT_FAN_MODE;
+        data.duty = Pwm2Duty(op.pwm);
+        return Ioctl(IOC_COMMAND_SET, &data);
+    }
+
+    // GET/RPM 传入风扇号，返回 duty/转速
+    op.value = op.fanNum;
+    return Ioctl(op.type == SIO_OP_GET ? IOC_COMMAND_GET : IOC_COMMAND_RPM, &op.value);
+}
+
+int SioDevice::Submit()
+{
+    int failCnt = 0;
+
+    QueueAudit();
+
+    // 本周期没有新的操作
+    if(m_submitted)
+    {
+        return 0;
+    }
+
+    for(auto it = m_ops.begin(); it != m_ops.end(); ++it)
+    {
+        Op& op = *it;
+
+        // 设置失败的风扇不再回读
+        if(op.type == SIO_OP_GET && it != m_ops.begin() && (it - 1)->type == SIO_OP_SET
+            && (it - 1)->fanNum == op.fanNum && (it - 1)->ret != 0)
+        {
+            op.ret = -1;
+            continue;
+        }
+
+        // 抽查排在本批最后，以本批设置之后的确认值为准
+        if(op.audit)
+        {
+            op.pwm = m_channels[op.fanNum].ackedPwm;
+            if(op.pwm < 0)
+            {
+                continue;
+            }
+        }
+
+        op.ret = Exec(op);
+        if(op.ret != 0)
+        {
+            syslog(LOG_INFO, "[ERROR] Fail to %s %s fan %d !!!", op.type == SIO_OP_SET ? "set" : "get", op.name, op.fanNum);
+            ++failCnt;
+            OnOpDone(op, false);
+            continue;
+        }
+
+        if(op.type == SIO_OP_GET && op.pwm >= 0)
+        {
+            int readPwm = Duty2Pwm(op.value);
+            if(op.pwm != readPwm && op.pwm != readPwm + 1 && op.pwm != readPwm - 1)
+            {
+                syslog(LOG_INFO, "[ERROR] %s pwm != readPwm !!! setPwm is %d, readPwm is %d, duty is %d", op.name, op.pwm, readPwm, op.value);
+                op.ret = -1;
+                ++failCnt;
+                OnOpDone(op, true);
+                continue;
+            }
+        }
+
+        OnOpDone(op, false);
+        if(op.pAckPwm != NULL)
+        {
+            *op.pAckPwm = op.pwm;
+            syslog(LOG_INFO, "[INFO] Set %s pwm success, current pwm is %d.", op.name, op.pwm);
+        }
+    }
+
+    m_submitted = true;
+    return failCnt;
+}
+
+int SioDevice::Result(int index) const
+{
+    return (index >= 0 && index < (int)m_ops.size()) ? m_ops[index].ret : -1;
+}
+
+int SioDevice::Value(int index) const
+{
+    return (index >= 0 && index < (int)m_ops.size()) ? m_ops[index].value : 0;
+}